@@ -22,6 +22,7 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysinfo.h"
 
 struct {
   struct spinlock lock;
@@ -148,4 +149,21 @@ bunpin(struct buf *b) {
   release(&bcache.lock);
 }
 
+// Count buffers referenced and buffers holding a block.
+void
+bcachestat(struct sysinfo *si)
+{
+  struct buf *b;
 
+  si->nbuf = NBUF;
+  si->bufused = 0;
+  si->bufvalid = 0;
+  acquire(&bcache.lock);
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->refcnt > 0)
+      si->bufused++;
+    if(b->valid)
+      si->bufvalid++;
+  }
+  release(&bcache.lock);
+}
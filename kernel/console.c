@@ -1,5 +1,6 @@
 //
-// Console input and output, to the uart.
+// Console input and output, to the uart, or to the
+// virtio console if qemu has one (see virtio_console.c).
 // Reads are line at a time.
 // Implements special input characters:
 //   newline -- end of line
@@ -21,28 +22,38 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
+#include "fcntl.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
 
 //
 // send one character to the uart.
+// called by printf, and to echo input characters,
+// but not from write().
 //
 void
 consputc(int c)
 {
-  extern volatile int panicked; // from printf.c
-
-  if(panicked){
-    for(;;)
-      ;
-  }
-
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc('\b'); uartputc(' '); uartputc('\b');
+    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
   } else {
-    uartputc(c);
+    uartputc_sync(c);
+  }
+}
+
+//
+// echo an input character to wherever write()s go.
+//
+static void
+consecho(int c)
+{
+  if(c == BACKSPACE){
+    consecho('\b'); consecho(' '); consecho('\b');
+  } else if(virtio_cons_putc(c) < 0){
+    consputc(c);
   }
 }
 
@@ -55,26 +66,36 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct pollq pollq; // processes polling for input
 } cons;
 
 //
 // user write()s to the console go here.
+// the characters go to the output buffer of the
+// virtio console or the uart, without cons.lock,
+// so a writer waits only while that buffer is full,
+// and doesn't hold up input or other writers
+// meanwhile. they are copied in a chunk at a time,
+// not a character at a time.
 //
 int
 consolewrite(struct file *f, int user_src, uint64 src, int n)
 {
-  int i;
+  char buf[128];
+  int i, m;
 
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    consputc(c);
+    if(virtio_cons_write(buf, m) < 0)
+      uartwrite(buf, m);
   }
-  release(&cons.lock);
 
-  return n;
+  return i;
 }
 
 //
@@ -82,13 +103,14 @@ consolewrite(struct file *f, int user_src, uint64 src, int n)
 // copy (up to) a whole input line to dst.
 // user_dist indicates whether dst is a user
 // or kernel address.
+// if f is O_NONBLOCK, return what there is,
+// or -EAGAIN if there is nothing.
 //
 int
 consoleread(struct file *f, int user_dst, uint64 dst, int n)
 {
-  uint target;
-  int c;
-  char cbuf;
+  uint target, i, m, k;
+  int eol;
 
   target = n;
   acquire(&cons.lock);
@@ -100,39 +122,75 @@ consoleread(struct file *f, int user_dst, uint64 dst, int n)
         release(&cons.lock);
         return -1;
       }
+      if(f && f->nonblock){
+        release(&cons.lock);
+        return n < target ? target - n : -EAGAIN;
+      }
       sleep(&cons.r, &cons.lock);
     }
 
-    c = cons.buf[cons.r++ % INPUT_BUF];
+    // the run of input that is contiguous in cons.buf,
+    // up to n bytes, and up to the end of the line or
+    // an end-of-file.
+    i = cons.r % INPUT_BUF;
+    m = cons.w - cons.r;
+    if(m > INPUT_BUF - i)
+      m = INPUT_BUF - i;
+    if(m > n)
+      m = n;
+    for(k = 0; k < m && cons.buf[i+k] != '\n' && cons.buf[i+k] != C('D'); k++)
+      ;
+    eol = k < m && cons.buf[i+k] == '\n';
+    if(eol)
+      k++;
 
-    if(c == C('D')){  // end-of-file
-      if(n < target){
-        // Save ^D for next time, to make sure
-        // caller gets a 0-byte result.
-        cons.r--;
-      }
-      break;
+    // copy the run to the user-space buffer at once.
+    if(k > 0){
+      if(either_copyout(user_dst, dst, &cons.buf[i], k) == -1)
+        break;
+      cons.r += k;
+      dst += k;
+      n -= k;
     }
 
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
-    --n;
-
-    if(c == '\n'){
+    if(eol){
       // a whole line has arrived, return to
       // the user-level read().
       break;
     }
+    if(k < m){  // end-of-file
+      // unless nothing has been read, save ^D for
+      // next time, to make sure caller gets a
+      // 0-byte result.
+      if(n == target)
+        cons.r++;
+      break;
+    }
   }
   release(&cons.lock);
 
   return target - n;
 }
 
+//
+// poll()s of the console go here.
+// input is ready once a whole line has arrived;
+// output waits at most for the uart to drain its
+// buffer, so is always ready.
+//
+int
+consolepoll(struct file *f, int events)
+{
+  int r = events & POLLOUT;
+
+  acquire(&cons.lock);
+  if((events & POLLIN) && cons.r != cons.w)
+    r |= POLLIN;
+  pollregister(&cons.pollq);
+  release(&cons.lock);
+  return r;
+}
+
 //
 // the console input interrupt handler.
 // uartintr() calls this for input character.
@@ -152,14 +210,14 @@ consoleintr(int c)
     while(cons.e != cons.w &&
           cons.buf[(cons.e-1) % INPUT_BUF] != '\n'){
       cons.e--;
-      consputc(BACKSPACE);
+      consecho(BACKSPACE);
     }
     break;
   case C('H'): // Backspace
   case '\x7f':
     if(cons.e != cons.w){
       cons.e--;
-      consputc(BACKSPACE);
+      consecho(BACKSPACE);
     }
     break;
   default:
@@ -167,7 +225,7 @@ consoleintr(int c)
       c = (c == '\r') ? '\n' : c;
 
       // echo back to the user.
-      consputc(c);
+      consecho(c);
 
       // store for consumption by consoleread().
       cons.buf[cons.e++ % INPUT_BUF] = c;
@@ -177,6 +235,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup(&cons.pollq);
       }
     }
     break;
@@ -192,8 +251,9 @@ consoleinit(void)
 
   uartinit();
 
-  // connect read and write system calls
-  // to consoleread and consolewrite.
+  // connect read, write and poll system calls
+  // to consoleread, consolewrite and consolepoll.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
@@ -1,18 +1,28 @@
 struct buf;
 struct context;
+struct dirent;
+struct direntplus;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
+struct pollq;
+struct mq;
+struct mq_attr;
 struct proc;
+struct sock;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct statfs;
 struct superblock;
+struct sysinfo;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            bcachestat(struct sysinfo*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
@@ -33,11 +43,27 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepoll(struct file*, int);
+int             filepread(struct file*, uint64, int n, int off);
+int             filepwrite(struct file*, uint64, int n, int off);
+int             filereaddir(struct file*, uint64, int n);
+int             filecopy(struct file*, struct file*, int n);
+int             filesplice(struct file*, struct file*, int, int);
+int             filesync(struct file*);
+struct file*    fdget(struct proc*, int);
+int             fdalloc(struct file*);
+struct file*    fdclear(struct proc*, int);
+int             fdcopy(struct proc*, struct proc*);
+void            fdcloseall(struct proc*);
 
 // fs.c
 void            fsinit(int);
+void            fsstat(int, struct statfs*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            direntstat(struct inode*, struct dirent*, struct direntplus*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -50,8 +76,11 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             sharei(struct inode*, uint, struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
+void            icachestat(struct sysinfo*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writei_ordered(struct inode*, int, uint64, uint, uint);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -62,19 +91,51 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit();
+int             kfreepages(void);
+void            kref(void*);
+int             krefcnt(void*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_stat(int, struct sysinfo*);
 void            begin_op(int);
 void            end_op(int);
 void            crash_op(int,int);
+void            log_free(int, uint);
+int             log_isfreed(int, uint);
+void            log_reuse(int, uint);
+int             log_recycled(int);
+void            log_sync(int);
+
+// mqueue.c
+void            mqinit(void);
+int             mqopen(char*, int, struct mq_attr*);
+void            mqclose(struct mq*);
+int             mqunlink(char*);
+int             mqsend(struct mq*, uint64, int, int, int);
+int             mqreceive(struct mq*, uint64, int, int*, int);
+void            mqstat(struct mq*, struct mq_attr*);
+int             mqpoll(struct mq*, int);
 
 // pipe.c
+struct pipe*    pipecreate(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipereadv(struct pipe*, struct iovec*, int, int);
+int             pipewritev(struct pipe*, struct iovec*, int, int, int);
+int             pipepoll(struct pipe*, int);
+int             pipesetsize(struct pipe*, int);
+int             pipesize(struct pipe*);
+int             pipesetlowat(struct pipe*, int, int);
+int             pipeclaimdata(struct pipe*, int);
+char*           pipedata(struct pipe*, uint, uint*);
+void            pipereleasedata(struct pipe*, int);
+int             pipeclaimroom(struct pipe*, int);
+char*           piperoom(struct pipe*, uint, uint*);
+void            pipereleaseroom(struct pipe*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -100,14 +161,33 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            pollregister(struct pollq*);
+void            pollwakeup(struct pollq*);
+void            polltick(void);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            procstat(struct sysinfo*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// sock.c
+void            sockinit(void);
+int             sockopen(void);
+int             sockpair(struct file**, struct file**);
+int             sockunbound(struct sock*);
+int             sockbind(struct sock*, struct inode*);
+int             socklisten(struct sock*, int);
+int             sockconnect(struct sock*, struct inode*, int);
+int             sockaccept(struct sock*, int);
+void            sockclose(struct sock*);
+int             sockreadv(struct sock*, struct iovec*, int, int);
+int             sockwritev(struct sock*, struct iovec*, int, int);
+int             sockpoll(struct sock*, int);
+struct pipe*    sockpipe(struct sock*, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -140,8 +220,21 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+int             fileopen(char*, int);
+
+// uring.c
+void            uringfree(struct proc*);
+
+// trace.c
+void            traceinit(void);
+void            tracerecord(struct proc*, int, uint64, uint64);
+void            tracefork(struct proc*, struct proc*);
+void            traceexit(struct proc*);
+
 // trap.c
 extern uint     ticks;
+extern uint64   timebase;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -150,7 +243,8 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartwrite(char*, int);
+void            uartputc_sync(int);
 int             uartgetc(void);
 
 // vm.c
@@ -167,6 +261,9 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+uint64          uvmshare(pagetable_t, uint64);
+uint64          uvmswap(pagetable_t, uint64, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -178,10 +275,17 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// virtio_console.c
+void            virtio_cons_init(void);
+int             virtio_cons_write(char*, int);
+int             virtio_cons_putc(int);
+void            virtio_cons_intr(void);
+
 // virtio_disk.c
 void            virtio_disk_init(int);
 void            virtio_disk_rw(int, struct buf *, int);
 void            virtio_disk_intr(int);
+void            virtio_disk_discard(int, uint, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -2,3 +2,16 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x800
+
+// fcntl() commands
+#define F_GETFL   3  // get O_ flags
+#define F_SETFL   4  // set O_NONBLOCK
+#define F_SETPIPE_SZ 5  // set pipe buffer size
+#define F_GETPIPE_SZ 6  // get pipe buffer size
+#define F_SETPIPE_RLOWAT 7  // wake pipe readers for this many bytes
+#define F_SETPIPE_WLOWAT 8  // wake pipe writers for this much room
+
+// returned (negated) when an O_NONBLOCK descriptor
+// would have to wait.
+#define EAGAIN    11
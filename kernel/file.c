@@ -12,11 +12,32 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "uio.h"
+#include "poll.h"
+
+// write a few blocks at a time to avoid exceeding
+// the maximum log transaction size. a chunk of MAXWRITE
+// bytes touches MAXWRITE/BSIZE + 1 data blocks if it isn't
+// aligned. besides those it logs at most the i-node, the
+// indirect block, the superblock, and the free bitmap and
+// reference count blocks; the log absorbs repeated writes
+// to one block, and a file system of FSSIZE blocks has
+// only a few of those (see mkfs), however many blocks the
+// chunk allocates, frees or unshares.
+// this really belongs lower down, since writei()
+// might be writing a device like the console.
+#define NWRITEMETA (1 + 1 + 1 + (FSSIZE/BPB + 1) + (FSSIZE/RPB + 1))
+#define MAXWRITE ((MAXOPBLOCKS - NWRITEMETA - 1) * BSIZE)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct devsw devsw[NDEV];
+
+// File structures are carved out of whole pages, which are
+// allocated when the free list runs dry and never returned.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct file *free;
 } ftable;
 
 void
@@ -30,17 +51,26 @@ struct file*
 filealloc(void)
 {
   struct file *f;
+  char *pg;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
+  if(ftable.free == 0){
+    release(&ftable.lock);
+    if((pg = kalloc()) == 0)
+      return 0;
+    memset(pg, 0, PGSIZE);
+    acquire(&ftable.lock);
+    for(f = (struct file*)pg; f + 1 <= (struct file*)(pg + PGSIZE); f++){
+      f->next = ftable.free;
+      ftable.free = f;
     }
   }
+  f = ftable.free;
+  ftable.free = f->next;
+  f->ref = 1;
+  f->nonblock = 0;
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -71,10 +101,16 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  f->next = ftable.free;
+  ftable.free = f;
   release(&ftable.lock);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
+  } else if(ff.type == FD_MQ){
+    mqclose(ff.mq);
+  } else if(ff.type == FD_SOCK){
+    sockclose(ff.sock);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
     begin_op(ff.ip->dev);
     iput(ff.ip);
@@ -82,6 +118,133 @@ fileclose(struct file *f)
   }
 }
 
+// Wait until all writes to file f so far are on the disk.
+int
+filesync(struct file *f)
+{
+  if(f->type == FD_INODE)
+    log_sync(f->ip->dev);
+  return 0;
+}
+
+// File descriptors.
+
+// Return the open file for descriptor fd of process p,
+// or 0 if fd is not open.
+struct file*
+fdget(struct proc *p, int fd)
+{
+  struct file **pg;
+
+  if(fd < 0 || fd >= NOFILE || (pg = p->fdt.page[fd / NFDPAGE]) == 0)
+    return 0;
+  return pg[fd % NFDPAGE];
+}
+
+// Index of the lowest zero bit in x, which has one.
+static int
+lowestzero(uint64 x)
+{
+  int i;
+
+  for(i = 0; x & 1; i++)
+    x >>= 1;
+  return i;
+}
+
+// Allocate the lowest free file descriptor for the given file,
+// growing the table if need be.
+// Takes over file reference from caller on success.
+int
+fdalloc(struct file *f)
+{
+  struct fdtable *t = &myproc()->fdt;
+  int fd, w;
+
+  if(t->full == ~0UL)
+    return -1;
+  w = lowestzero(t->full);
+  fd = w * 64 + lowestzero(t->used[w]);
+  if(t->page[fd / NFDPAGE] == 0){
+    if((t->page[fd / NFDPAGE] = (struct file**)kalloc()) == 0)
+      return -1;
+    memset(t->page[fd / NFDPAGE], 0, PGSIZE);
+  }
+  t->page[fd / NFDPAGE][fd % NFDPAGE] = f;
+  t->used[w] |= 1UL << (fd % 64);
+  if(t->used[w] == ~0UL)
+    t->full |= 1UL << w;
+  return fd;
+}
+
+// Close descriptor fd of process p, without closing
+// the file. Returns the file, or 0 if fd was not open.
+struct file*
+fdclear(struct proc *p, int fd)
+{
+  struct fdtable *t = &p->fdt;
+  struct file *f;
+
+  if((f = fdget(p, fd)) == 0)
+    return 0;
+  t->page[fd / NFDPAGE][fd % NFDPAGE] = 0;
+  t->used[fd / 64] &= ~(1UL << (fd % 64));
+  t->full &= ~(1UL << (fd / 64));
+  return f;
+}
+
+// Give np copies of p's file descriptors, for fork().
+// Allocates all of np's table pages before taking any
+// file references, so there is nothing to undo if
+// that fails.
+int
+fdcopy(struct proc *np, struct proc *p)
+{
+  int i;
+
+  for(i = 0; i < NOFILE/NFDPAGE; i++){
+    if(p->fdt.page[i] == 0)
+      continue;
+    if((np->fdt.page[i] = (struct file**)kalloc()) == 0){
+      while(--i >= 0){
+        if(np->fdt.page[i]){
+          kfree((char*)np->fdt.page[i]);
+          np->fdt.page[i] = 0;
+        }
+      }
+      return -1;
+    }
+    memmove(np->fdt.page[i], p->fdt.page[i], PGSIZE);
+  }
+  memmove(np->fdt.used, p->fdt.used, sizeof(p->fdt.used));
+  np->fdt.full = p->fdt.full;
+
+  for(i = 0; i < NOFILE; i++){
+    if(p->fdt.used[i / 64] & (1UL << (i % 64)))
+      filedup(np->fdt.page[i / NFDPAGE][i % NFDPAGE]);
+  }
+  return 0;
+}
+
+// Close all of p's file descriptors, and free its table.
+void
+fdcloseall(struct proc *p)
+{
+  struct file *f;
+  int fd, i;
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if((f = fdclear(p, fd)) != 0)
+      fileclose(f);
+  }
+  for(i = 0; i < NOFILE/NFDPAGE; i++){
+    if(p->fdt.page[i]){
+      kfree((char*)p->fdt.page[i]);
+      p->fdt.page[i] = 0;
+    }
+  }
+}
+
 // Get metadata about file f.
 // addr is a user virtual address, pointing to a struct stat.
 int
@@ -101,32 +264,192 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Read from inode file f at *off into the iovcnt
+// buffers in iov, and advance *off. The buffers are
+// user virtual addresses if user is set, else kernel.
+static int
+inoderead(struct file *f, int user, struct iovec *iov, int iovcnt, uint *off)
+{
+  int k, r, tot;
+
+  tot = 0;
+  ilock(f->ip);
+  for(k = 0; k < iovcnt; k++){
+    if((r = readi(f->ip, user, (uint64)iov[k].iov_base, *off, iov[k].iov_len)) < 0){
+      iunlock(f->ip);
+      return -1;
+    }
+    *off += r;
+    tot += r;
+    if(r < iov[k].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
+// Write the iovcnt buffers in iov, user or kernel as
+// for inoderead(), to inode file f at *off, and advance *off.
+// All of the buffers go in one transaction unless the
+// blocks they log would not fit; big buffers log only
+// metadata (see writei_ordered()).
+static int
+inodewrite(struct file *f, int user, struct iovec *iov, int iovcnt, uint *off)
+{
+  // a logged writei() of at most MAXWRITE bytes touches no
+  // more than this many data blocks.
+  int maxblocks = MAXWRITE/BSIZE + 1;
+  int i, k, n, n1, nb, r, tot, used;
+  uint64 addr;
+
+  r = tot = used = 0;
+  begin_op(f->ip->dev);
+  ilock(f->ip);
+  for(k = 0; k < iovcnt; k++){
+    addr = (uint64)iov[k].iov_base;
+    n = iov[k].iov_len;
+    for(i = 0; i < n; i += r){
+      n1 = n - i;
+      r = 0;
+      if(n1 > MAXWRITE)
+        r = writei_ordered(f->ip, user, addr + i, *off, n1);
+      if(r == 0){
+        if(n1 > MAXWRITE)
+          n1 = MAXWRITE;
+        nb = (*off + n1 - 1)/BSIZE - *off/BSIZE + 1;
+        if(used + nb > maxblocks){
+          // commit to make room in the log.
+          iunlock(f->ip);
+          end_op(f->ip->dev);
+          begin_op(f->ip->dev);
+          ilock(f->ip);
+          used = 0;
+        }
+        used += nb;
+        if((r = writei(f->ip, user, addr + i, *off, n1)) >= 0 && r != n1)
+          panic("short filewrite");
+      }
+      if(r < 0)
+        goto out;
+      *off += r;
+      tot += r;
+    }
+  }
+out:
+  iunlock(f->ip);
+  end_op(f->ip->dev);
+  return r < 0 ? -1 : tot;
+}
+
+// Read from file f into the iovcnt buffers in iov.
+// The buffers are user virtual addresses.
 int
-fileread(struct file *f, uint64 addr, int n)
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
 {
-  int r = 0;
+  int k, r, tot;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    return pipereadv(f->pipe, iov, iovcnt, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(f, 1, addr, n);
+    tot = 0;
+    for(k = 0; k < iovcnt; k++){
+      r = devsw[f->major].read(f, 1, (uint64)iov[k].iov_base, iov[k].iov_len);
+      if(r < 0)
+        return tot > 0 ? tot : r;  // r may be -EAGAIN
+      tot += r;
+      if(r < iov[k].iov_len)
+        break;
+    }
+    return tot;
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-  } else {
-    panic("fileread");
+    return inoderead(f, 1, iov, iovcnt, &f->off);
+  } else if(f->type == FD_MQ){
+    return -1;  // use mq_receive()
+  } else if(f->type == FD_SOCK){
+    return sockreadv(f->sock, iov, iovcnt, f->nonblock);
   }
+  panic("fileread");
+}
 
-  return r;
+// Write the iovcnt buffers in iov to file f.
+// The buffers are user virtual addresses.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int k, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE){
+    return pipewritev(f->pipe, iov, iovcnt, f->nonblock, 0);
+  } else if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+      return -1;
+    tot = 0;
+    for(k = 0; k < iovcnt; k++){
+      r = devsw[f->major].write(f, 1, (uint64)iov[k].iov_base, iov[k].iov_len);
+      if(r < 0)
+        return -1;
+      tot += r;
+    }
+    return tot;
+  } else if(f->type == FD_INODE){
+    return inodewrite(f, 1, iov, iovcnt, &f->off);
+  } else if(f->type == FD_MQ){
+    return -1;  // use mq_send()
+  } else if(f->type == FD_SOCK){
+    return sockwritev(f->sock, iov, iovcnt, f->nonblock);
+  }
+  panic("filewrite");
+}
+
+// Which of events (POLLIN, POLLOUT) f is ready for, plus
+// POLLHUP if the other end of a pipe is closed. For pipes,
+// message queues, sockets and devices that can make a process wait,
+// also queue the calling process to be woken when that
+// changes; inodes and other devices are always ready.
+int
+filepoll(struct file *f, int events)
+{
+  if(f->readable == 0)
+    events &= ~POLLIN;
+  if(f->writable == 0)
+    events &= ~POLLOUT;
+
+  if(f->type == FD_PIPE){
+    return pipepoll(f->pipe, events);
+  } else if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV)
+      return POLLNVAL;
+    if(devsw[f->major].poll)
+      return devsw[f->major].poll(f, events);
+    return events;
+  } else if(f->type == FD_INODE){
+    return events;
+  } else if(f->type == FD_MQ){
+    return mqpoll(f->mq, events);
+  } else if(f->type == FD_SOCK){
+    return sockpoll(f->sock, events);
+  }
+  panic("filepoll");
+}
+
+// Read from file f.
+// addr is a user virtual address.
+int
+fileread(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1);
 }
 
 // Write to file f.
@@ -134,49 +457,327 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
 
-  if(f->writable == 0)
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1);
+}
+
+// Read from file f at offset off, without using or
+// changing f->off. Only inode files have offsets.
+// addr is a user virtual address.
+int
+filepread(struct file *f, uint64 addr, int n, int off)
+{
+  struct iovec iov;
+  uint o = off;
+
+  if(f->readable == 0 || f->type != FD_INODE || off < 0)
     return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inoderead(f, 1, &iov, 1, &o);
+}
+
+// Write to file f at offset off, without using or
+// changing f->off.
+// addr is a user virtual address.
+int
+filepwrite(struct file *f, uint64 addr, int n, int off)
+{
+  struct iovec iov;
+  uint o = off;
+
+  if(f->writable == 0 || f->type != FD_INODE || off < 0)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodewrite(f, 1, &iov, 1, &o);
+}
+
+// Copy up to n bytes from file in to file out inside the
+// kernel, starting at and advancing both files' offsets.
+// Whole blocks at block-aligned offsets are shared between
+// the two files rather than copied (see sharei()), which
+// logs only the reference counts and out's block map and
+// so fits in one transaction however many blocks it shares.
+// Other bytes are copied a few blocks at a time, like
+// filewrite().
+// Returns the number of bytes copied, 0 at the end of in.
+int
+filecopy(struct file *in, struct file *out, int n)
+{
+  struct inode *a, *b;
+  char *buf;
+  int m, r, tot, ok;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if(in->type != FD_INODE || out->type != FD_INODE || in->ip == out->ip)
+    return -1;
+
+  // both must be plain files, which is checked one inode
+  // at a time: in may be a directory, and locking it along
+  // with a file in it, in pointer order, could deadlock
+  // with unlink(), which locks the directory first. an
+  // open inode's type doesn't change.
+  ilock(in->ip);
+  ok = in->ip->type == T_FILE;
+  iunlock(in->ip);
+  ilock(out->ip);
+  ok = ok && out->ip->type == T_FILE;
+  iunlock(out->ip);
+  if(!ok)
+    return -1;
+
+  if(n < 0 || (buf = kalloc()) == 0)
+    return -1;
+
+  // lock the two inodes in a fixed order, so that
+  // copies in opposite directions can't deadlock.
+  a = in->ip < out->ip ? in->ip : out->ip;
+  b = in->ip < out->ip ? out->ip : in->ip;
+
+  r = 0;
+  for(tot = 0; tot < n; tot += r){
+    begin_op(in->ip->dev);
+    ilock(a);
+    ilock(b);
+    if(in->off >= in->ip->size){
+      r = 0;
+    } else {
+      m = n - tot;
+      if(m > in->ip->size - in->off)
+        m = in->ip->size - in->off;
+      r = 0;
+      if(in->off % BSIZE == 0 && out->off % BSIZE == 0 && m >= BSIZE){
+        if((r = sharei(in->ip, in->off, out->ip, out->off, m / BSIZE)) < 0)
+          panic("filecopy: sharei");
+        r *= BSIZE;
+      }
+      if(r == 0){
+        if(m > MAXWRITE)
+          m = MAXWRITE;
+        if((r = readi(in->ip, 0, (uint64)buf, in->off, m)) > 0)
+          r = writei(out->ip, 0, (uint64)buf, out->off, r);
+      }
+      if(r > 0){
+        in->off += r;
+        out->off += r;
+      }
+    }
+    iunlock(b);
+    iunlock(a);
+    end_op(in->ip->dev);
+
+    if(r <= 0)
+      break;
+  }
+  kfree(buf);
+
+  if(r < 0 && tot == 0)
+    return -1;
+  return tot;
+}
+
+// Read up to n bytes from file f, an inode or a device,
+// into kernel memory at dst.
+static int
+filereadk(struct file *f, char *dst, int n)
+{
+  struct iovec iov;
+
+  if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+      return -1;
+    return devsw[f->major].read(f, 0, (uint64)dst, n);
+  } else if(f->type == FD_INODE){
+    iov.iov_base = dst;
+    iov.iov_len = n;
+    return inoderead(f, 0, &iov, 1, &f->off);
+  }
+  return -1;
+}
+
+// Write n bytes from kernel memory at src to pipe pi.
+// Returns the number written, which is less than n
+// only if nonblock is set and the pipe filled up,
+// or -1 if none could be.
+static int
+pipewritek(struct pipe *pi, char *src, int n, int nonblock)
+{
+  int r, tot;
+  uint c, m;
+  char *dst;
+
+  for(tot = 0; tot < n; tot += r){
+    if((r = pipeclaimroom(pi, nonblock)) < 0)
+      return tot > 0 ? tot : r;
+    r = min(r, n - tot);
+    for(m = 0; m < r; m += c){
+      dst = piperoom(pi, m, &c);
+      c = min(c, r - m);
+      memmove(dst, src + tot + m, c);
+    }
+    pipereleaseroom(pi, r);
+  }
+  return tot;
+}
+
+// Write n bytes from kernel memory at src to file f.
+// Returns the number written, which is less than n
+// only if f is a non-blocking pipe that filled up,
+// or -1 if none could be.
+static int
+filewritek(struct file *f, char *src, int n)
+{
+  struct iovec iov;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    return pipewritek(f->pipe, src, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(f, 1, addr, n);
+    return devsw[f->major].write(f, 0, (uint64)src, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op(f->ip->dev);
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op(f->ip->dev);
+    iov.iov_base = src;
+    iov.iov_len = n;
+    return inodewrite(f, 0, &iov, 1, &f->off);
+  }
+  return -1;
+}
 
-      if(r < 0)
+// Move up to n bytes from device file in to pipe file out.
+// Reading a device may sleep until there is input, so it is
+// read into a page of its own rather than into the pipe's
+// buffer, which would keep the pipe's other writers out
+// meanwhile. Reads no more than the pipe has room for when
+// called, so that waiting for room after the read is brief.
+static int
+splicedev(struct file *in, struct file *out, int n)
+{
+  char *buf;
+  int r;
+
+  if((r = pipeclaimroom(out->pipe, out->nonblock)) < 0)
+    return r;
+  pipereleaseroom(out->pipe, 0);
+  n = min(n, min(r, PGSIZE));
+  if((buf = kalloc()) == 0)
+    return -1;
+  if((r = filereadk(in, buf, n)) > 0)
+    r = pipewritek(out->pipe, buf, r, 0);  // don't drop what was read
+  kfree(buf);
+  return r;
+}
+
+// Move up to n bytes from file in to file out inside the
+// kernel, one of them a pipe. The bytes go straight between
+// the pipe's buffer and the other file: a file is read into
+// the free part of the buffer, and written from the part
+// that holds data; but see splicedev() for devices. Moves
+// no more than the pipe holds, or has room for, when called;
+// with tee set, both files must be pipes and the bytes are
+// copied without consuming them. Returns the number of
+// bytes moved, 0 if in is a pipe whose write side is closed.
+int
+filesplice(struct file *in, struct file *out, int n, int tee)
+{
+  int avail, r, tot;
+  uint c;
+  char *p;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(tee && (in->type != FD_PIPE || out->type != FD_PIPE))
+    return -1;
+  if(in->type == FD_PIPE && out->type == FD_PIPE && in->pipe == out->pipe)
+    return -1;
+
+  if(in->type == FD_PIPE){
+    if((avail = pipeclaimdata(in->pipe, in->nonblock)) <= 0)
+      return avail;
+    avail = min(avail, n);
+    r = 0;
+    for(tot = 0; tot < avail; tot += r){
+      p = pipedata(in->pipe, tot, &c);
+      c = min(c, avail - tot);
+      if((r = filewritek(out, p, c)) <= 0)
+        break;
+      if(r < c){
+        tot += r;
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      }
     }
-    ret = (i == n ? n : -1);
+    pipereleasedata(in->pipe, tee ? 0 : tot);
+  } else if(out->type == FD_PIPE && in->type == FD_DEVICE){
+    return splicedev(in, out, n);
+  } else if(out->type == FD_PIPE){
+    if((avail = pipeclaimroom(out->pipe, out->nonblock)) < 0)
+      return avail;
+    avail = min(avail, n);
+    r = 0;
+    for(tot = 0; tot < avail; tot += r){
+      p = piperoom(out->pipe, tot, &c);
+      c = min(c, avail - tot);
+      if((r = filereadk(in, p, c)) <= 0)
+        break;
+      if(r < c){
+        tot += r;
+        break;
+      }
+    }
+    pipereleaseroom(out->pipe, tot);
   } else {
-    panic("filewrite");
+    return -1;
   }
-
-  return ret;
+  if(r < 0 && tot == 0)
+    return r;
+  return tot;
 }
 
+// Read directory entries, each with the type, size and link
+// count of the inode it names, from directory file f.
+// addr is a user virtual address, pointing to an array of
+// struct direntplus that is n bytes long.
+// Returns the number of bytes copied, 0 at end of directory.
+int
+filereaddir(struct file *f, uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct dirent de;
+  struct direntplus dep;
+  int tot = 0;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+
+  begin_op(f->ip->dev);
+  while(tot + (int)sizeof(dep) <= n){
+    ilock(f->ip);
+    if(f->ip->type != T_DIR){
+      iunlock(f->ip);
+      end_op(f->ip->dev);
+      return -1;
+    }
+    if(readi(f->ip, 0, (uint64)&de, f->off, sizeof(de)) != sizeof(de)){
+      iunlock(f->ip);
+      break;
+    }
+    f->off += sizeof(de);
+    iunlock(f->ip);
+
+    if(de.inum == 0)
+      continue;
+    direntstat(f->ip, &de, &dep);
+    if(copyout(p->pagetable, addr + tot, (char *)&dep, sizeof(dep)) < 0){
+      end_op(f->ip->dev);
+      return -1;
+    }
+    tot += sizeof(dep);
+  }
+  end_op(f->ip->dev);
+
+  return tot;
+}
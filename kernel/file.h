@@ -1,13 +1,17 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_MQ, FD_SOCK } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail with -EAGAIN instead of waiting
   struct pipe *pipe; // FD_PIPE
+  struct mq *mq;     // FD_MQ
+  struct sock *sock; // FD_SOCK
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE and FD_DEVICE
   short major;       // FD_DEVICE
   short minor;       // FD_DEVICE
+  struct file *next; // ftable free list, when ref is 0
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -34,6 +38,7 @@ struct inode {
 struct devsw {
   int (*read)(struct file *, int, uint64, int);
   int (*write)(struct file *, int, uint64, int);
+  int (*poll)(struct file *, int);
 };
 
 extern struct devsw devsw[];
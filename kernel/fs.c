@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "sysinfo.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -45,6 +46,42 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  // recovery may have installed a logged superblock,
+  // with newer free counts (see sbadjust()).
+  readsb(dev, &sb);
+}
+
+// Adjust the free block and free inode counts kept in the
+// superblock by db and di. The superblock buffer's lock
+// serializes updates, and the change goes through the log
+// with the rest of the caller's transaction, so the counts
+// always agree with the bitmap and the inode blocks on disk.
+static void
+sbadjust(int dev, int db, int di)
+{
+  struct buf *bp;
+  struct superblock *dsb;
+
+  bp = bread(dev, 1);
+  dsb = (struct superblock*)bp->data;
+  dsb->nfree += db;
+  dsb->nifree += di;
+  sb.nfree = dsb->nfree;
+  sb.nifree = dsb->nifree;
+  log_write(bp);
+  brelse(bp);
+}
+
+// Report file system usage from the superblock counts,
+// without scanning the bitmap or the inode blocks.
+void
+fsstat(int dev, struct statfs *st)
+{
+  st->bsize = BSIZE;
+  st->blocks = sb.nblocks;
+  st->bfree = sb.nfree;
+  st->files = sb.ninodes;
+  st->ffree = sb.nifree;
 }
 
 // Zero a block.
@@ -61,38 +98,141 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Mark a free block in use and return its number,
+// or return 0 if there is none. Blocks freed by the
+// current transaction (see log_free()) are taken only
+// if reuse is set.
 static uint
-balloc(uint dev)
+bclaim(uint dev, int reuse)
 {
   int b, bi, m;
   struct buf *bp;
 
-  bp = 0;
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
+        if(log_isfreed(dev, b + bi)){
+          if(!reuse)
+            continue;
+          log_reuse(dev, b + bi);
+        }
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        sbadjust(dev, -1, 0);
         return b + bi;
       }
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return 0;
+}
+
+// Allocate a zeroed disk block.
+static uint
+balloc(uint dev)
+{
+  uint b;
+
+  // fail without reading every bitmap block when
+  // the superblock says the disk is full.
+  if(sb.nfree == 0)
+    panic("balloc: out of blocks");
+
+  // blocks freed by the current transaction are
+  // taken only if nothing else is left.
+  if((b = bclaim(dev, 0)) == 0 && (b = bclaim(dev, 1)) == 0)
+    panic("balloc: out of blocks");
+  bzero(dev, b);
+  return b;
+}
+
+// Allocate a disk block for writei_ordered(), which writes
+// it directly rather than through the log. Only blocks that
+// were already free when the current transaction began will
+// do, so that if the system crashes before the transaction
+// commits, no other file can own the data written to it.
+// The block is not zeroed. Returns 0 if there is none.
+static uint
+bdalloc(uint dev)
+{
+  if(sb.nfree == 0)
+    return 0;
+  return bclaim(dev, 0);
+}
+
+// Block reference counts.
+//
+// copy_file_range() lets files share data blocks. For each
+// block, the reference count area holds the number of files
+// that point at the block besides the first one: 0 for a
+// block with a single owner, as every block starts out.
+// bfree() drops a reference instead of freeing a shared
+// block, and bmapw() gives a file its own copy of a shared
+// block before the file's copy is modified.
+
+// Return the number of extra references to block b.
+static int
+bref(uint dev, uint b)
+{
+  struct buf *bp;
+  int r;
+
+  bp = bread(dev, RBLOCK(b, sb));
+  r = bp->data[b % RPB];
+  brelse(bp);
+  return r;
 }
 
-// Free a disk block.
+// Add a reference to block b.
+// Returns -1 if b already has as many as the count can hold.
+static int
+brefinc(uint dev, uint b)
+{
+  struct buf *bp;
+
+  bp = bread(dev, RBLOCK(b, sb));
+  if(bp->data[b % RPB] >= MAXREF){
+    brelse(bp);
+    return -1;
+  }
+  bp->data[b % RPB]++;
+  log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
+// If block b is shared, drop one reference to it and
+// return 1. Return 0 if the caller holds the only one.
+static int
+brefdec(uint dev, uint b)
+{
+  struct buf *bp;
+
+  bp = bread(dev, RBLOCK(b, sb));
+  if(bp->data[b % RPB] == 0){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[b % RPB]--;
+  log_write(bp);
+  brelse(bp);
+  return 1;
+}
+
+// Free a disk block, or drop a reference to it if
+// other files share it.
 static void
 bfree(int dev, uint b)
 {
   struct buf *bp;
   int bi, m;
 
+  if(brefdec(dev, b))
+    return;
+
   bp = bread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
@@ -100,7 +240,9 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  log_free(dev, b);
   brelse(bp);
+  sbadjust(dev, 1, 0);
 }
 
 // Inodes.
@@ -190,6 +332,22 @@ iinit()
 
 static struct inode* iget(uint dev, uint inum);
 
+// Count inode cache entries in use.
+void
+icachestat(struct sysinfo *si)
+{
+  struct inode *ip;
+
+  si->ninode = NINODE;
+  si->inodeused = 0;
+  acquire(&icache.lock);
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if(ip->ref > 0)
+      si->inodeused++;
+  }
+  release(&icache.lock);
+}
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
@@ -208,6 +366,7 @@ ialloc(uint dev, short type)
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      sbadjust(dev, 0, -1);
       return iget(dev, inum);
     }
     brelse(bp);
@@ -347,6 +506,7 @@ iput(struct inode *ip)
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
+    sbadjust(ip->dev, 0, 1);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
@@ -405,6 +565,62 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Make addr the nth block of inode ip, allocating the
+// indirect block if necessary. Returns the block that
+// addr replaces, or 0 if there was none.
+static uint
+bmapset(struct inode *ip, uint bn, uint addr)
+{
+  uint old, *a;
+  struct buf *bp;
+
+  if(bn < NDIRECT){
+    old = ip->addrs[bn];
+    ip->addrs[bn] = addr;
+    return old;
+  }
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    if(ip->addrs[NDIRECT] == 0)
+      ip->addrs[NDIRECT] = balloc(ip->dev);
+    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    a = (uint*)bp->data;
+    old = a[bn];
+    a[bn] = addr;
+    log_write(bp);
+    brelse(bp);
+    return old;
+  }
+
+  panic("bmapset: out of range");
+}
+
+// Like bmap(), for a block that is about to be written:
+// if the block is shared with other files, give ip its
+// own copy of it first.
+static uint
+bmapw(struct inode *ip, uint bn)
+{
+  uint addr, naddr;
+  struct buf *from, *to;
+
+  addr = bmap(ip, bn);
+  if(bref(ip->dev, addr) == 0)
+    return addr;
+
+  naddr = balloc(ip->dev);
+  from = bread(ip->dev, addr);
+  to = bread(ip->dev, naddr);
+  memmove(to->data, from->data, BSIZE);
+  log_write(to);
+  brelse(from);
+  brelse(to);
+  bmapset(ip, bn, naddr);
+  bfree(ip->dev, addr);  // drops ip's reference
+  return naddr;
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -495,7 +711,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmapw(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
@@ -517,6 +733,115 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return n;
 }
 
+// Write data to inode like writei(), for writes too big for
+// one transaction when each data block is logged. Only the
+// metadata goes through the log: the inode, the indirect
+// block, and the bitmap, superblock and reference count
+// blocks, which fit in one transaction however much data
+// is written. Data blocks are written straight to disk with
+// bwrite() before that transaction commits (ordered mode).
+// Blocks that are not shared are overwritten in place, so a
+// crash may leave part of the new data in the file. Other
+// blocks are replaced by ones from bdalloc(), which a crash
+// before the commit leaves free.
+// Caller must hold ip->lock.
+// Returns the number of bytes written, which may be short
+// (or 0) if bdalloc() runs out of blocks; the caller should
+// commit and then write the rest.
+int
+writei_ordered(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m, addr, naddr;
+  struct buf *bp, *from;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+  if(log_recycled(ip->dev))
+    return 0;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(off - off%BSIZE < ip->size)
+      addr = bmap(ip, off/BSIZE);
+    else
+      addr = 0;  // past the end of the file
+    if(addr == 0 || bref(ip->dev, addr) > 0){
+      if((naddr = bdalloc(ip->dev)) == 0)
+        break;
+      bp = bread(ip->dev, naddr);
+      if(addr){
+        // keep the bytes of a shared block that this
+        // write does not cover.
+        from = bread(ip->dev, addr);
+        memmove(bp->data, from->data, BSIZE);
+        brelse(from);
+      } else {
+        memset(bp->data, 0, BSIZE);
+      }
+    } else {
+      naddr = 0;
+      bp = bread(ip->dev, addr);
+    }
+    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      brelse(bp);
+      if(naddr)
+        bfree(ip->dev, naddr);  // never linked; ip keeps addr
+      break;
+    }
+    bwrite(bp);
+    brelse(bp);
+    // link a new block only once its contents are on disk.
+    if(naddr && (addr = bmapset(ip, off/BSIZE, naddr)) != 0)
+      bfree(ip->dev, addr);  // drops ip's reference
+  }
+
+  if(tot > 0){
+    if(off > ip->size)
+      ip->size = off;
+    iupdate(ip);
+  }
+  return tot;
+}
+
+// Make the nb blocks of dst starting at byte offset doff
+// share the nb blocks of src starting at soff, instead of
+// copying them. Both offsets must be block aligned, and the
+// source blocks must lie within src. Blocks of dst that get
+// replaced are freed (or unshared).
+// Caller must hold both inodes' locks.
+// Returns the number of blocks shared, which is less than
+// nb if a source block has too many references already, or
+// dst reaches its largest size; 0 if doff is past the end
+// of dst, which the caller's writei() will refuse too.
+// Returns -1 if the offsets are bad.
+int
+sharei(struct inode *src, uint soff, struct inode *dst, uint doff, uint nb)
+{
+  uint i, addr, old;
+
+  if(soff % BSIZE || doff % BSIZE || soff + nb*BSIZE > src->size)
+    return -1;
+  if(doff > dst->size || doff >= MAXFILE*BSIZE)
+    return 0;
+  if(nb > MAXFILE - doff/BSIZE)
+    nb = MAXFILE - doff/BSIZE;
+
+  for(i = 0; i < nb; i++){
+    addr = bmap(src, soff/BSIZE + i);
+    if(brefinc(src->dev, addr) < 0)
+      break;
+    if((old = bmapset(dst, doff/BSIZE + i, addr)) != 0)
+      bfree(dst->dev, old);
+  }
+
+  if(doff + i*BSIZE > dst->size)
+    dst->size = doff + i*BSIZE;
+  iupdate(dst);
+  return i;
+}
+
 // Directories
 
 int
@@ -583,6 +908,26 @@ dirlink(struct inode *dp, char *name, uint inum)
   return 0;
 }
 
+// Fill in *dpp from the directory entry de of directory dp,
+// reading the named inode for its type, size and link count.
+// Caller must not hold dp->lock, since de may name dp itself
+// or its parent.
+// Must be called inside a transaction since it calls iput().
+void
+direntstat(struct inode *dp, struct dirent *de, struct direntplus *dpp)
+{
+  struct inode *ip;
+
+  ip = iget(dp->dev, de->inum);
+  ilock(ip);
+  dpp->inum = ip->inum;
+  memmove(dpp->name, de->name, DIRSIZ);
+  dpp->type = ip->type;
+  dpp->nlink = ip->nlink;
+  dpp->size = ip->size;
+  iunlockput(ip);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -7,7 +7,7 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                free bit map | block reference counts | data blocks]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -20,6 +20,9 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint nfree;        // Number of free blocks
+  uint nifree;       // Number of free inodes
+  uint refstart;     // Block number of first reference count block
 };
 
 #define FSMAGIC 0x10203040
@@ -50,6 +53,15 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
+// Reference counts per block (one byte each)
+#define RPB           BSIZE
+
+// Most extra references a shared block can have
+#define MAXREF        255
+
+// Block of reference counts containing the count for block b
+#define RBLOCK(b, sb) ((b)/RPB + sb.refstart)
+
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
 
@@ -58,3 +70,13 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entry together with the metadata of the inode
+// it names, as returned by readdirplus().
+struct direntplus {
+  uint inum;
+  char name[DIRSIZ];
+  short type;
+  short nlink;
+  uint64 size;
+};
+
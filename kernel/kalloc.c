@@ -23,6 +23,32 @@ struct {
   struct run *freelist;
 } kmem;
 
+// Free-page counts, one per CPU and each in a cache line of
+// its own, so that kalloc() and kfree() update them after
+// releasing kmem.lock, without atomics or contention: only a
+// CPU's own kalloc() and kfree() write its count, with
+// interrupts off. A CPU's count goes negative when it
+// allocates pages others freed; only the sum, kfreepages(),
+// means anything.
+struct {
+  int n;
+} __attribute__ ((aligned (64))) nfree[NCPU];
+
+// Add d to this CPU's free-page count.
+static void
+nfreeadd(int d)
+{
+  push_off();
+  nfree[cpuid()].n += d;
+  pop_off();
+}
+
+// Reference counts of pages that may be mapped in more
+// than one place (see kref()). kalloc() sets a page's
+// count to 1 and kfree() frees it when it drops to 0.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+int pageref[(PHYSTOP - KERNBASE) / PGSIZE];
+
 void
 kinit()
 {
@@ -35,14 +61,17 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    pageref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If the page has other references, only drop this one.
 void
 kfree(void *pa)
 {
@@ -50,6 +79,8 @@ kfree(void *pa)
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  if(__sync_sub_and_fetch(&pageref[PA2REF(pa)], 1) > 0)
+    return;
 
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
@@ -60,6 +91,7 @@ kfree(void *pa)
   r->next = kmem.freelist;
   kmem.freelist = r;
   release(&kmem.lock);
+  nfreeadd(1);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -76,7 +108,39 @@ kalloc(void)
     kmem.freelist = r->next;
   release(&kmem.lock);
 
-  if(r)
+  if(r){
+    nfreeadd(-1);
     memset((char*)r, 5, PGSIZE); // fill with junk
+    pageref[PA2REF(r)] = 1;
+  }
   return (void*)r;
 }
+
+// Add a reference to page pa, which kalloc() returned,
+// for a second mapping of it; kfree() drops one.
+void
+kref(void *pa)
+{
+  __sync_fetch_and_add(&pageref[PA2REF(pa)], 1);
+}
+
+// Return how many references page pa has.
+int
+krefcnt(void *pa)
+{
+  return pageref[PA2REF(pa)];
+}
+
+// Return the number of free pages.
+// Reads the counters without locking,
+// so the answer may be a little stale.
+int
+kfreepages(void)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NCPU; i++)
+    n += nfree[i].n;
+  return n;
+}
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysinfo.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -45,11 +46,15 @@ struct log {
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+  int nfreed;      // blocks freed by the current transaction,
+  uchar freed[FSSIZE/8+1]; // and a bit for each of them.
+  int recycled;    // some freed block was allocated again.
 };
 struct log log[NDISK];
 
 static void recover_from_log(int);
 static void commit(int);
+static void discard_freed(int);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -173,6 +178,18 @@ end_op(int dev)
   }
 }
 
+// Wait until every FS system call that has finished has
+// also been committed: until no call is outstanding, and
+// no commit is in progress.
+void
+log_sync(int dev)
+{
+  acquire(&log[dev].lock);
+  while(log[dev].outstanding > 0 || log[dev].committing)
+    sleep(&log, &log[dev].lock);
+  release(&log[dev].lock);
+}
+
 // Copy modified blocks from cache to log.
 static void
 write_log(int dev)
@@ -198,6 +215,7 @@ commit(int dev)
     install_trans(dev); // Now install writes to home locations
     log[dev].lh.n = 0;
     write_head(dev);    // Erase the transaction from the log
+    discard_freed(dev); // Let the disk drop blocks freed by it
   }
 }
 
@@ -235,3 +253,109 @@ log_write(struct buf *b)
 }
 
 
+
+// bfree() has freed block b in the current transaction.
+// Remember it, so that the disk can be told to discard it
+// once the transaction has committed. Until then balloc()
+// avoids handing b out again, since a crash before the
+// commit would leave b still belonging to its old file.
+// Called with the bitmap block locked, before b becomes
+// visible as free.
+void
+log_free(int dev, uint b)
+{
+  if(b >= FSSIZE)
+    return;
+  acquire(&log[dev].lock);
+  if((log[dev].freed[b/8] & (1 << (b%8))) == 0){
+    log[dev].freed[b/8] |= 1 << (b%8);
+    log[dev].nfreed++;
+  }
+  release(&log[dev].lock);
+}
+
+// Was block b freed by the current transaction?
+int
+log_isfreed(int dev, uint b)
+{
+  int r;
+
+  if(b >= FSSIZE)
+    return 0;
+  acquire(&log[dev].lock);
+  r = (log[dev].freed[b/8] & (1 << (b%8))) != 0;
+  release(&log[dev].lock);
+  return r;
+}
+
+// balloc() is handing out block b, freed by the current
+// transaction, because nothing else is left. It must not
+// be discarded at commit.
+void
+log_reuse(int dev, uint b)
+{
+  if(b >= FSSIZE)
+    return;
+  acquire(&log[dev].lock);
+  if(log[dev].freed[b/8] & (1 << (b%8))){
+    log[dev].freed[b/8] &= ~(1 << (b%8));
+    log[dev].nfreed--;
+    log[dev].recycled = 1;
+  }
+  release(&log[dev].lock);
+}
+
+// Has the current transaction handed out a block that it
+// also freed? Such a block still belongs to its old file on
+// disk, so writei_ordered() must not write it directly.
+int
+log_recycled(int dev)
+{
+  int r;
+
+  acquire(&log[dev].lock);
+  r = log[dev].recycled;
+  release(&log[dev].lock);
+  return r;
+}
+
+// Report how full dev's current transaction is.
+void
+log_stat(int dev, struct sysinfo *si)
+{
+  acquire(&log[dev].lock);
+  si->logsize = LOGSIZE;
+  si->logused = log[dev].lh.n;
+  si->logops = log[dev].outstanding;
+  release(&log[dev].lock);
+}
+
+// Tell the disk about the blocks freed by the transaction
+// that just committed, one request per run of adjacent
+// blocks. Called from commit(), so no FS system call can
+// be allocating or freeing blocks meanwhile.
+static void
+discard_freed(int dev)
+{
+  uint b, start;
+  int run;
+
+  log[dev].recycled = 0;
+  if(log[dev].nfreed == 0)
+    return;
+
+  run = 0;
+  start = 0;
+  for(b = 0; b <= FSSIZE; b++){
+    if(b < FSSIZE && (log[dev].freed[b/8] & (1 << (b%8)))){
+      if(run == 0)
+        start = b;
+      run++;
+    } else if(run > 0){
+      virtio_disk_discard(dev, start, run);
+      run = 0;
+    }
+  }
+  memset(log[dev].freed, 0, sizeof(log[dev].freed));
+  log[dev].nfreed = 0;
+}
@@ -31,7 +31,11 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    traceinit();     // system call tracing
+    mqinit();        // message queues
+    sockinit();      // sockets
     virtio_disk_init(minor(ROOTDEV)); // emulated hard disk
+    virtio_cons_init(); // virtio console, if qemu has one
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
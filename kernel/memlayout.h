@@ -25,11 +25,13 @@
 #define VIRTION(n) (0x10000000L + ((n+1) * 0x1000))
 #define VIRTIO0_IRQ 1
 #define VIRTIO1_IRQ 2
+#define VIRTIO2_IRQ 3
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TICKINTERVAL 1000000 // cycles between timer interrupts; about 1/10th second in qemu.
 
 // qemu puts programmable interrupt controller here.
 #define PLIC 0x0c000000L
@@ -63,6 +65,20 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   USYSCALL (read-only kernel data, see struct usyscall)
+//   URING (submission and completion rings, see uring.c)
 //   TRAPFRAME (p->tf, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define URING (TRAPFRAME - PGSIZE)
+#define USYSCALL (URING - PGSIZE)
+
+// The USYSCALL page lets user code answer some questions
+// without a system call (see ugetpid() in user/ulib.c).
+// Uptime in ticks is (time CSR - timebase) / interval.
+struct usyscall {
+  int pid;          // Process ID
+  int cpu;          // CPU the process last ran on
+  uint64 timebase;  // time CSR value when ticks was 0
+  uint64 interval;  // time CSR cycles per tick
+};
@@ -0,0 +1,344 @@
+//
+// POSIX-style message queues.
+//
+// mq_open() finds a queue by name, or creates it, and returns
+// a file descriptor for it. mq_send() queues a message whole,
+// with a priority, and mq_receive() takes the oldest message
+// of the highest priority, whole, so no one has to look for
+// message boundaries in a byte stream.
+//
+// Message buffers are carved out of whole pages, which are
+// allocated when the free list runs dry and never returned,
+// like struct files. Each queue keeps a list of messages per
+// priority and a bitmap of the lists that are non-empty, so
+// sending and receiving take the same time however full the
+// queue is. Senders and receivers sleep on their own channels,
+// and are woken only when some are asleep.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "mqueue.h"
+
+struct mqmsg {
+  struct mqmsg *next;
+  int len;
+  char data[MQ_MSGSIZE];
+};
+
+struct mq {
+  struct spinlock lock;
+  char name[MQ_NAMESIZE];
+  int ref;        // open files; protected by mqtable.lock
+  int linked;     // name is in the table; mqtable.lock
+  int maxmsg;
+  int msgsize;
+  int n;          // messages queued
+  uint prios;     // bit p set if head[p] is non-empty
+  struct mqmsg *head[MQ_PRIO_MAX];
+  struct mqmsg *tail[MQ_PRIO_MAX];
+  int nrecv;      // receivers asleep, on &nrecv
+  int nsend;      // senders asleep, on &nsend
+  struct pollq pollq;
+};
+
+struct {
+  struct spinlock lock;
+  struct mq mq[NMQ];
+} mqtable;
+
+struct {
+  struct spinlock lock;
+  struct mqmsg *free;
+} mqmsgs;
+
+void
+mqinit(void)
+{
+  struct mq *mq;
+
+  initlock(&mqtable.lock, "mqtable");
+  initlock(&mqmsgs.lock, "mqmsgs");
+  for(mq = mqtable.mq; mq < &mqtable.mq[NMQ]; mq++)
+    initlock(&mq->lock, "mq");
+}
+
+// Allocate a message buffer.
+static struct mqmsg*
+msgalloc(void)
+{
+  struct mqmsg *m;
+  char *pg;
+
+  acquire(&mqmsgs.lock);
+  if(mqmsgs.free == 0){
+    release(&mqmsgs.lock);
+    if((pg = kalloc()) == 0)
+      return 0;
+    acquire(&mqmsgs.lock);
+    for(m = (struct mqmsg*)pg; m + 1 <= (struct mqmsg*)(pg + PGSIZE); m++){
+      m->next = mqmsgs.free;
+      mqmsgs.free = m;
+    }
+  }
+  m = mqmsgs.free;
+  mqmsgs.free = m->next;
+  release(&mqmsgs.lock);
+  return m;
+}
+
+static void
+msgfree(struct mqmsg *m)
+{
+  acquire(&mqmsgs.lock);
+  m->next = mqmsgs.free;
+  mqmsgs.free = m;
+  release(&mqmsgs.lock);
+}
+
+// Free mq's messages and its table entry, once it has
+// neither a name nor open files. Caller holds mqtable.lock.
+static void
+mqfree(struct mq *mq)
+{
+  struct mqmsg *m;
+  int p;
+
+  if(mq->ref > 0 || mq->linked)
+    return;
+  for(p = 0; p < MQ_PRIO_MAX; p++){
+    while((m = mq->head[p]) != 0){
+      mq->head[p] = m->next;
+      msgfree(m);
+    }
+  }
+  mq->n = 0;
+  mq->prios = 0;
+}
+
+// Open the queue called name, creating it with attributes
+// attr (or defaults, if attr is 0) if it doesn't exist and
+// omode has O_CREATE. Returns a file descriptor, or -1.
+int
+mqopen(char *name, int omode, struct mq_attr *attr)
+{
+  struct mq *mq, *q;
+  struct file *f;
+  int fd;
+
+  if(name[0] == 0)
+    return -1;
+  if(attr && (attr->mq_maxmsg < 1 || attr->mq_maxmsg > MQ_MAXMSG ||
+              attr->mq_msgsize < 1 || attr->mq_msgsize > MQ_MSGSIZE))
+    return -1;
+
+  acquire(&mqtable.lock);
+  mq = 0;
+  for(q = mqtable.mq; q < &mqtable.mq[NMQ]; q++){
+    if(q->linked && strncmp(q->name, name, MQ_NAMESIZE) == 0){
+      mq = q;
+      break;
+    }
+  }
+  if(mq == 0){
+    if((omode & O_CREATE) == 0){
+      release(&mqtable.lock);
+      return -1;
+    }
+    for(q = mqtable.mq; q < &mqtable.mq[NMQ]; q++){
+      if(q->ref == 0 && !q->linked){
+        mq = q;
+        break;
+      }
+    }
+    if(mq == 0){
+      release(&mqtable.lock);
+      return -1;
+    }
+    safestrcpy(mq->name, name, MQ_NAMESIZE);
+    mq->linked = 1;
+    mq->maxmsg = attr ? attr->mq_maxmsg : 16;
+    mq->msgsize = attr ? attr->mq_msgsize : MQ_MSGSIZE;
+    mq->n = 0;
+    mq->prios = 0;
+    memset(mq->head, 0, sizeof(mq->head));
+    memset(mq->tail, 0, sizeof(mq->tail));
+    mq->nrecv = 0;
+    mq->nsend = 0;
+    memset(&mq->pollq, 0, sizeof(mq->pollq));
+  }
+  mq->ref++;
+  release(&mqtable.lock);
+
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+    if(f)
+      fileclose(f);
+    mqclose(mq);
+    return -1;
+  }
+  f->type = FD_MQ;
+  f->mq = mq;
+  f->readable = !(omode & O_WRONLY);
+  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
+  return fd;
+}
+
+// Drop an open file's reference to mq.
+void
+mqclose(struct mq *mq)
+{
+  acquire(&mqtable.lock);
+  mq->ref--;
+  mqfree(mq);
+  release(&mqtable.lock);
+}
+
+// Remove name from the table. The queue lives on
+// until the last file open on it is closed.
+int
+mqunlink(char *name)
+{
+  struct mq *mq;
+
+  acquire(&mqtable.lock);
+  for(mq = mqtable.mq; mq < &mqtable.mq[NMQ]; mq++){
+    if(mq->linked && strncmp(mq->name, name, MQ_NAMESIZE) == 0){
+      mq->linked = 0;
+      mqfree(mq);
+      release(&mqtable.lock);
+      return 0;
+    }
+  }
+  release(&mqtable.lock);
+  return -1;
+}
+
+// Queue the n-byte message at user address addr with
+// priority prio, waiting for room unless nonblock is set.
+int
+mqsend(struct mq *mq, uint64 addr, int n, int prio, int nonblock)
+{
+  struct proc *p = myproc();
+  struct mqmsg *m;
+
+  if(n < 0 || n > mq->msgsize || prio < 0 || prio >= MQ_PRIO_MAX)
+    return -1;
+  if((m = msgalloc()) == 0)
+    return -1;
+  if(copyin(p->pagetable, m->data, addr, n) < 0){
+    msgfree(m);
+    return -1;
+  }
+  m->len = n;
+  m->next = 0;
+
+  acquire(&mq->lock);
+  while(mq->n == mq->maxmsg){
+    if(p->killed || nonblock){
+      release(&mq->lock);
+      msgfree(m);
+      return p->killed ? -1 : -EAGAIN;
+    }
+    mq->nsend++;
+    sleep(&mq->nsend, &mq->lock);
+    mq->nsend--;
+  }
+  if(mq->head[prio])
+    mq->tail[prio]->next = m;
+  else
+    mq->head[prio] = m;
+  mq->tail[prio] = m;
+  mq->prios |= 1U << prio;
+  mq->n++;
+  if(mq->nrecv > 0)
+    wakeup(&mq->nrecv);
+  pollwakeup(&mq->pollq);
+  release(&mq->lock);
+  return 0;
+}
+
+// Take the oldest message of the highest priority, waiting
+// for one unless nonblock is set, and copy it to user
+// address addr, which has room for n bytes; n must be at
+// least the queue's message size. Returns the message's
+// length, and sets *prio to its priority.
+int
+mqreceive(struct mq *mq, uint64 addr, int n, int *prio, int nonblock)
+{
+  struct proc *p = myproc();
+  struct mqmsg *m;
+  int pr, len;
+
+  if(n < mq->msgsize)
+    return -1;
+
+  acquire(&mq->lock);
+  while(mq->n == 0){
+    if(p->killed || nonblock){
+      release(&mq->lock);
+      return p->killed ? -1 : -EAGAIN;
+    }
+    mq->nrecv++;
+    sleep(&mq->nrecv, &mq->lock);
+    mq->nrecv--;
+  }
+  for(pr = MQ_PRIO_MAX-1; (mq->prios & (1U << pr)) == 0; pr--)
+    ;
+  m = mq->head[pr];
+  // copy before dequeueing, so that a bad address
+  // doesn't lose the message.
+  if(copyout(p->pagetable, addr, m->data, m->len) < 0){
+    release(&mq->lock);
+    return -1;
+  }
+  if((mq->head[pr] = m->next) == 0)
+    mq->prios &= ~(1U << pr);
+  mq->n--;
+  if(mq->nsend > 0)
+    wakeup(&mq->nsend);
+  pollwakeup(&mq->pollq);
+  release(&mq->lock);
+
+  len = m->len;
+  msgfree(m);
+  *prio = pr;
+  return len;
+}
+
+// Fill in attr's sizes and current message count.
+void
+mqstat(struct mq *mq, struct mq_attr *attr)
+{
+  acquire(&mq->lock);
+  attr->mq_maxmsg = mq->maxmsg;
+  attr->mq_msgsize = mq->msgsize;
+  attr->mq_curmsgs = mq->n;
+  release(&mq->lock);
+}
+
+// POLLIN if mq has a message, POLLOUT if it has room.
+// Queues the caller to hear of changes.
+int
+mqpoll(struct mq *mq, int events)
+{
+  int r = 0;
+
+  acquire(&mq->lock);
+  if((events & POLLIN) && mq->n > 0)
+    r |= POLLIN;
+  if((events & POLLOUT) && mq->n < mq->maxmsg)
+    r |= POLLOUT;
+  pollregister(&mq->pollq);
+  release(&mq->lock);
+  return r;
+}
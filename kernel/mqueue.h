@@ -0,0 +1,13 @@
+// POSIX-style message queues (see kernel/mqueue.c).
+
+#define MQ_PRIO_MAX  32  // priorities run from 0 to MQ_PRIO_MAX-1
+#define MQ_MSGSIZE  496  // largest message a queue can take
+#define MQ_MAXMSG    64  // most messages a queue can hold
+#define MQ_NAMESIZE  32  // longest queue name, with its 0
+
+struct mq_attr {
+  int mq_flags;    // O_NONBLOCK or 0; reported by mq_getattr()
+  int mq_maxmsg;   // messages the queue holds
+  int mq_msgsize;  // largest message
+  int mq_curmsgs;  // messages queued now; reported by mq_getattr()
+};
@@ -1,7 +1,6 @@
 #define NPROC        10  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NOFILE     4096  // open files per process
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       0  // device number of file system root disk
@@ -12,3 +11,6 @@
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define NDISK        2
+#define PIPEMAXPAGES 16  // maximum pipe buffer size in pages
+#define NMQ          16  // maximum number of message queues
+#define NSOCK        32  // maximum number of sockets
@@ -7,34 +7,93 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
+#include "poll.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
+// The buffer starts as one page; fcntl(F_SETPIPE_SZ)
+// can change it to any power of two pages up to
+// PIPEMAXPAGES, so that nread and nwrite wrap
+// around 2^32 consistently with the buffer.
+//
+// splice() moves bytes between the buffer and a file with
+// the lock released, since reading and writing files can
+// sleep. While it does, it keeps other readers (rbusy) or
+// writers (wbusy) out, and the buffer from being resized;
+// see pipeclaimdata() and pipeclaimroom().
+//
+// To save context switches, readers are woken only once
+// the pipe holds rlowat bytes (fcntl(F_SETPIPE_RLOWAT)),
+// writers only once wlowat bytes are free, and neither
+// when no one sleeps. Readers also get less than rlowat
+// once the writers go idle, i.e. a whole clock tick passes
+// with no write, since a writer that has said all it has
+// to say may be waiting for the reader's reply. Readers and
+// pollers that find bytes held back like this look again
+// each tick; a writer that keeps writing doesn't wake them.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *buf[PIPEMAXPAGES]; // buffer pages
+  uint size;      // buffer size in bytes
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a splice is taking bytes out
+  int wbusy;      // a splice is putting bytes in
+  uint rlowat;    // bytes that make readers worth waking
+  uint wlowat;    // free bytes that do for writers; 0 = half
+  int nrsleep;    // readers asleep on nread
+  int nwsleep;    // writers asleep on nwrite
+  int nrtick;     // readers asleep on ticks, waiting for idle
+  uint wtick;     // ticks at the last write
+  struct pollq pollq; // processes polling either end
 };
 
-int
-pipealloc(struct file **f0, struct file **f1)
+// Allocate a pipe with both sides open and no files,
+// for pipealloc() and for sockets.
+struct pipe*
+pipecreate(void)
 {
   struct pipe *pi;
 
-  pi = 0;
-  *f0 = *f1 = 0;
-  if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
-    goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
-    goto bad;
+    return 0;
+  memset(pi->buf, 0, sizeof(pi->buf));
+  if((pi->buf[0] = kalloc()) == 0){
+    kfree((char*)pi);
+    return 0;
+  }
+  pi->size = PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rbusy = 0;
+  pi->wbusy = 0;
+  pi->rlowat = 1;
+  pi->wlowat = 0;
+  pi->nrsleep = 0;
+  pi->nwsleep = 0;
+  pi->nrtick = 0;
+  pi->wtick = 0;
   memset(&pi->lock, 0, sizeof(pi->lock));
+  memset(&pi->pollq, 0, sizeof(pi->pollq));
+  return pi;
+}
+
+int
+pipealloc(struct file **f0, struct file **f1)
+{
+  struct pipe *pi;
+
+  *f0 = *f1 = 0;
+  if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
+    goto bad;
+  if((pi = pipecreate()) == 0)
+    goto bad;
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -46,8 +105,6 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -55,73 +112,527 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+// The watermarks, no more than the buffer size, and
+// with rlowat + wlowat <= size + 1, so that however much
+// the pipe holds, one side or the other is worth waking.
+static uint
+piperlowat(struct pipe *pi)
+{
+  return min(pi->rlowat, pi->size);
+}
+
+static uint
+pipewlowat(struct pipe *pi)
+{
+  uint w;
+
+  w = pi->wlowat ? pi->wlowat : pi->size / 2;
+  return min(w, pi->size + 1 - piperlowat(pi));
+}
+
+// Have the writers gone idle: has a whole clock tick
+// passed since the last write? Reads ticks without
+// tickslock, which at worst makes the answer a tick late.
+static int
+pipeidle(struct pipe *pi)
+{
+  return ticks - pi->wtick >= 2;
+}
+
+// Is there enough in the pipe to wake a reader for:
+// rlowat bytes, any bytes once the writers have gone
+// idle, or anything at all (even nothing, which reads
+// as end of file) once the write side is closed?
+static int
+pipereadable(struct pipe *pi)
+{
+  uint n = pi->nwrite - pi->nread;
+
+  return n >= piperlowat(pi) || (n > 0 && pipeidle(pi)) || pi->writeopen == 0;
+}
+
+// Is there enough room to wake a writer for?
+static int
+pipewritable(struct pipe *pi)
+{
+  return pi->nread + pi->size - pi->nwrite >= pipewlowat(pi) || pi->readopen == 0;
+}
+
+// Wake sleeping readers and pollers if the pipe is
+// readable, or regardless if force is set.
+static void
+pipewakereaders(struct pipe *pi, int force)
+{
+  if(!force && !pipereadable(pi))
+    return;
+  if(pi->nrsleep > 0)
+    wakeup(&pi->nread);
+  if(pi->nrtick > 0)
+    wakeup(&ticks);
+  pollwakeup(&pi->pollq);
+}
+
+// Wake sleeping writers and pollers if the pipe is
+// writable, or regardless if force is set.
+static void
+pipewakewriters(struct pipe *pi, int force)
+{
+  if(!force && !pipewritable(pi))
+    return;
+  if(pi->nwsleep > 0)
+    wakeup(&pi->nwrite);
+  pollwakeup(&pi->pollq);
+}
+
+// Sleep as a reader until pipewakereaders(), or, if
+// the pipe holds bytes short of rlowat, until the next
+// clock tick, to see whether the writers have gone idle.
+static void
+pipesleepread(struct pipe *pi)
+{
+  if(pi->nwrite != pi->nread){
+    pi->nrtick++;
+    sleep(&ticks, &pi->lock);
+    pi->nrtick--;
+  } else {
+    pi->nrsleep++;
+    sleep(&pi->nread, &pi->lock);
+    pi->nrsleep--;
+  }
+}
+
+// Sleep as a writer until pipewakewriters(), first
+// waking readers for what the caller has written.
+static void
+pipesleepwrite(struct pipe *pi)
+{
+  pipewakereaders(pi, 0);
+  pi->nwsleep++;
+  sleep(&pi->nwrite, &pi->lock);
+  pi->nwsleep--;
+}
+
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
-    wakeup(&pi->nread);
+    pipewakereaders(pi, 1);
   } else {
     pi->readopen = 0;
-    wakeup(&pi->nwrite);
+    pipewakewriters(pi, 1);
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < pi->size / PGSIZE; i++)
+      kfree(pi->buf[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Return the address of the buffer byte for stream
+// position n, and in *len how many bytes from there
+// on are contiguous in the buffer.
+static char*
+pipebuf(struct pipe *pi, uint n, uint *len)
+{
+  n %= pi->size;
+  *len = PGSIZE - n % PGSIZE;
+  return pi->buf[n / PGSIZE] + n % PGSIZE;
+}
+
+// Change the buffer size to n bytes, rounded up to a
+// power of two pages. Fails if the pipe holds more
+// than that. Returns the new size.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  char *buf[PIPEMAXPAGES], *old[PIPEMAXPAGES], *src;
+  int i, npg, oldnpg;
+  uint k, m, size, dst;
+
+  if(n <= 0 || n > PIPEMAXPAGES*PGSIZE)
+    return -1;
+  for(npg = 1; npg*PGSIZE < n; npg *= 2)
+    ;
+  for(i = 0; i < npg; i++){
+    if((buf[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(buf[i]);
+      return -1;
+    }
+  }
+  size = npg*PGSIZE;
+
+  acquire(&pi->lock);
+  while(pi->rbusy || pi->wbusy)
+    pipesleepwrite(pi);
+  if(pi->nwrite - pi->nread > size){
+    release(&pi->lock);
+    for(i = 0; i < npg; i++)
+      kfree(buf[i]);
+    return -1;
+  }
+  // copy what the pipe holds to the same stream
+  // positions in the new buffer.
+  for(k = pi->nread; k != pi->nwrite; k += m){
+    src = pipebuf(pi, k, &m);
+    dst = k % size;
+    m = min(m, pi->nwrite - k);
+    m = min(m, PGSIZE - dst % PGSIZE);
+    memmove(buf[dst / PGSIZE] + dst % PGSIZE, src, m);
+  }
+  oldnpg = pi->size / PGSIZE;
+  for(i = 0; i < oldnpg; i++)
+    old[i] = pi->buf[i];
+  for(i = 0; i < npg; i++)
+    pi->buf[i] = buf[i];
+  pi->size = size;
+  pipewakereaders(pi, 0);
+  pipewakewriters(pi, 0);
+  release(&pi->lock);
+
+  for(i = 0; i < oldnpg; i++)
+    kfree(old[i]);
+  return size;
+}
+
+int
+pipesize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Set the reader (if rd) or writer watermark;
+// a writer watermark of 0 means half the buffer.
+int
+pipesetlowat(struct pipe *pi, int rd, int n)
+{
+  if(n < (rd ? 1 : 0))
+    return -1;
+  acquire(&pi->lock);
+  if(rd)
+    pi->rlowat = n;
+  else
+    pi->wlowat = n;
+  pipewakereaders(pi, 0);
+  pipewakewriters(pi, 0);
+  release(&pi->lock);
+  return 0;
+}
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return pipewritev(pi, &iov, 1, 0, 0);
+}
+
+// Make the buffer page holding stream position n the
+// pipe's alone, so that it can be written: a page given
+// to the pipe by vmsplice(), or left by a reader in
+// exchange for one it took (see pipereadv()), may still
+// be mapped copy-on-write by a process.
+static int
+pipeown(struct pipe *pi, uint n)
+{
+  char **pg, *mem;
+
+  pg = &pi->buf[n % pi->size / PGSIZE];
+  if(krefcnt(*pg) == 1)
+    return 0;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, *pg, PGSIZE);
+  kfree(*pg);
+  *pg = mem;
+  return 0;
+}
+
+// Write the iovcnt user buffers in iov to the pipe,
+// holding the pipe lock throughout except while waiting
+// for room. So the write is atomic only if it fits in
+// the free space; otherwise other writers' bytes may come
+// between those written before and after a wait.
+// Copies as much as is contiguous in both the user buffer
+// and the ring with each copyin().
+// If gift is set (vmsplice()), whole user pages that land
+// on a whole free buffer page are not copied: the user's
+// page is made copy-on-write and put in the buffer instead.
+// If nonblock is set, write only what fits, and return
+// -EAGAIN if nothing does.
+int
+pipewritev(struct pipe *pi, struct iovec *iov, int iovcnt, int nonblock, int gift)
+{
+  int i, k, tot, empty;
+  uint m, c;
+  uint64 addr, pa;
+  char *dst, **pg;
   struct proc *pr = myproc();
 
+  tot = 0;
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || myproc()->killed){
-        release(&pi->lock);
-        return -1;
+  empty = pi->nwrite == pi->nread;
+  for(k = 0; k < iovcnt; k++){
+    for(i = 0; i < iov[k].iov_len; i += m){
+      while(pi->wbusy || pi->nwrite == pi->nread + pi->size){  //DOC: pipewrite-full
+        if(pi->readopen == 0 || myproc()->killed){
+          tot = -1;
+          goto out;
+        }
+        if(nonblock){
+          if(tot == 0)
+            tot = -EAGAIN;
+          goto out;
+        }
+        pipesleepwrite(pi);
+      }
+      addr = (uint64)iov[k].iov_base + i;
+      m = min(iov[k].iov_len - i, pi->nread + pi->size - pi->nwrite);
+      if(gift && m >= PGSIZE && addr % PGSIZE == 0 && pi->nwrite % PGSIZE == 0 &&
+         addr + PGSIZE <= pr->sz && (pa = uvmshare(pr->pagetable, addr)) != 0){
+        pg = &pi->buf[pi->nwrite % pi->size / PGSIZE];
+        kfree(*pg);
+        *pg = (char*)pa;
+        m = PGSIZE;
+      } else {
+        if(pipeown(pi, pi->nwrite) < 0)
+          goto out;
+        dst = pipebuf(pi, pi->nwrite, &c);
+        m = min(m, c);
+        if(copyin(pr->pagetable, dst, addr, m) == -1)
+          goto out;
       }
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
+      pi->nwrite += m;
+      tot += m;
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-      break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
   }
-  wakeup(&pi->nread);
+out:
+  if(tot > 0)
+    pi->wtick = ticks;
+  // readers asleep on an empty pipe start watching
+  // for the writers to go idle.
+  pipewakereaders(pi, empty && tot > 0);
   release(&pi->lock);
-  return n;
+  return tot;
 }
 
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return pipereadv(pi, &iov, 1, 0);
+}
+
+// Read from the pipe into the iovcnt user buffers in iov,
+// filling each before moving on to the next. Like
+// piperead(), waits only until the pipe holds rlowat
+// bytes, or its write side is closed. If nonblock is set,
+// takes whatever there is, or returns -EAGAIN if nothing.
+// Like pipewritev(), copies contiguous runs at once,
+// and doesn't copy whole pages: a whole buffer page of
+// data going to a whole user page is mapped there, and
+// the user's old page takes its place in the buffer.
+int
+pipereadv(struct pipe *pi, struct iovec *iov, int iovcnt, int nonblock)
+{
+  int i, k, tot;
+  uint m, c;
+  uint64 addr, old;
+  char *src, **pg;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while(pi->rbusy || !pipereadable(pi)){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    if(nonblock){
+      if(!pi->rbusy && pi->nread != pi->nwrite)
+        break;
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    pipesleepread(pi); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+  tot = 0;
+  for(k = 0; k < iovcnt; k++){
+    for(i = 0; i < iov[k].iov_len; i += m){  //DOC: piperead-copy
+      if(pi->nread == pi->nwrite)
+        goto out;
+      addr = (uint64)iov[k].iov_base + i;
+      m = min(iov[k].iov_len - i, pi->nwrite - pi->nread);
+      pg = &pi->buf[pi->nread % pi->size / PGSIZE];
+      if(m >= PGSIZE && addr % PGSIZE == 0 && pi->nread % PGSIZE == 0 &&
+         addr + PGSIZE <= pr->sz && (old = uvmswap(pr->pagetable, addr, (uint64)*pg)) != 0){
+        *pg = (char*)old;
+        m = PGSIZE;
+      } else {
+        src = pipebuf(pi, pi->nread, &c);
+        m = min(m, c);
+        if(copyout(pr->pagetable, addr, src, m) == -1)
+          goto out;
+      }
+      pi->nread += m;
+      tot += m;
+    }
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+out:
+  pipewakewriters(pi, 0);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  return tot;
+}
+
+// Wait until the pipe holds rlowat bytes, or its write side
+// is closed, and no one else is reading; then claim the read
+// side for the caller to take bytes out with the lock
+// released, using pipedata(). Returns how many bytes the
+// pipe holds, which stay there until pipereleasedata();
+// 0 if the write side is closed. Like pipereadv(), returns
+// -EAGAIN instead of waiting if nonblock is set.
+int
+pipeclaimdata(struct pipe *pi, int nonblock)
+{
+  int n;
+
+  acquire(&pi->lock);
+  while(pi->rbusy || !pipereadable(pi)){
+    if(myproc()->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(nonblock){
+      if(!pi->rbusy && pi->nread != pi->nwrite)
+        break;
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    pipesleepread(pi);
+  }
+  n = pi->nwrite - pi->nread;
+  if(n > 0)
+    pi->rbusy = 1;
+  release(&pi->lock);
+  return n;
+}
+
+// Return the address of the claimed data off bytes past
+// the read position, and in *len how many bytes from there
+// on are contiguous in the buffer. The caller holds the
+// read side, so no one else moves nread or resizes the
+// buffer, and the lock is not needed.
+char*
+pipedata(struct pipe *pi, uint off, uint *len)
+{
+  return pipebuf(pi, pi->nread + off, len);
+}
+
+// Consume n bytes of the claimed data, and let other
+// readers in.
+void
+pipereleasedata(struct pipe *pi, int n)
+{
+  acquire(&pi->lock);
+  pi->nread += n;
+  pi->rbusy = 0;
+  pipewakereaders(pi, 1);
+  pipewakewriters(pi, 1);
+  release(&pi->lock);
+}
+
+// Wait until the pipe has room and no one else is
+// writing; then claim the write side for the caller to
+// put bytes in with the lock released, using piperoom().
+// Returns how many bytes are free; -1 if the read side is
+// closed, or -EAGAIN instead of waiting if nonblock is set.
+int
+pipeclaimroom(struct pipe *pi, int nonblock)
+{
+  int n, k;
+
+  acquire(&pi->lock);
+  while(pi->wbusy || pi->nwrite == pi->nread + pi->size){
+    if(pi->readopen == 0 || myproc()->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    pipesleepwrite(pi);
+  }
+  if(pi->readopen == 0){
+    release(&pi->lock);
+    return -1;
+  }
+  n = pi->nread + pi->size - pi->nwrite;
+  for(k = 0; k < n; k += PGSIZE - (pi->nwrite + k) % PGSIZE){
+    if(pipeown(pi, pi->nwrite + k) < 0){
+      release(&pi->lock);
+      return -1;
+    }
+  }
+  pi->wbusy = 1;
+  release(&pi->lock);
+  return n;
+}
+
+// Like pipedata(), for the claimed free space.
+char*
+piperoom(struct pipe *pi, uint off, uint *len)
+{
+  return pipebuf(pi, pi->nwrite + off, len);
+}
+
+// Add n bytes put in the claimed space to the pipe,
+// and let other writers in.
+void
+pipereleaseroom(struct pipe *pi, int n)
+{
+  int empty;
+
+  acquire(&pi->lock);
+  empty = pi->nwrite == pi->nread;
+  pi->nwrite += n;
+  pi->wbusy = 0;
+  if(n > 0)
+    pi->wtick = ticks;
+  pipewakewriters(pi, 1);
+  pipewakereaders(pi, empty && n > 0);
+  release(&pi->lock);
+}
+
+// Which of events (POLLIN, POLLOUT) are ready on the
+// pipe, by the watermarks, plus POLLHUP if the other end
+// is closed. Queues the caller to hear of changes.
+int
+pipepoll(struct pipe *pi, int events)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if((events & POLLIN) && pipereadable(pi))
+    r |= POLLIN;
+  else if((events & POLLIN) && pi->nwrite != pi->nread)
+    polltick();  // bytes held back until the writers go idle
+  if((events & POLLOUT) && pipewritable(pi))
+    r |= POLLOUT;
+  if(((events & POLLIN) && pi->writeopen == 0) ||
+     ((events & POLLOUT) && pi->readopen == 0))
+    r |= POLLHUP;
+  pollregister(&pi->pollq);
   release(&pi->lock);
-  return i;
+  return r;
 }
@@ -0,0 +1,10 @@
+struct pollfd {
+  int fd;         // File descriptor, or negative to skip
+  short events;   // Events to wait for
+  short revents;  // Events that happened
+};
+
+#define POLLIN   0x001  // data to read
+#define POLLOUT  0x004  // room to write
+#define POLLHUP  0x010  // other end closed (always reported)
+#define POLLNVAL 0x020  // fd is not open (always reported)
@@ -8,6 +8,7 @@
 #include "file.h"
 #include "proc.h"
 #include "defs.h"
+#include "sysinfo.h"
 
 struct cpu cpus[NCPU];
 
@@ -114,6 +115,18 @@ found:
     return 0;
   }
 
+  // Allocate the page user code can read kernel data from.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    kfree((void*)p->tf);
+    p->tf = 0;
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+  p->usyscall->timebase = timebase;
+  p->usyscall->interval = TICKINTERVAL;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
 
@@ -135,6 +148,10 @@ freeproc(struct proc *p)
   if(p->tf)
     kfree((void*)p->tf);
   p->tf = 0;
+  uringfree(p);
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -145,6 +162,7 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->tracemask = 0;
   p->state = UNUSED;
 }
 
@@ -169,6 +187,11 @@ proc_pagetable(struct proc *p)
   mappages(pagetable, TRAPFRAME, PGSIZE,
            (uint64)(p->tf), PTE_R | PTE_W);
 
+  // map the usyscall page below the rings, read-only
+  // for user code.
+  mappages(pagetable, USYSCALL, PGSIZE,
+           (uint64)(p->usyscall), PTE_R | PTE_U);
+
   return pagetable;
 }
 
@@ -179,6 +202,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, PGSIZE, 0);
   uvmunmap(pagetable, TRAPFRAME, PGSIZE, 0);
+  uvmunmap(pagetable, USYSCALL, PGSIZE, 0);
   if(sz > 0)
     uvmfree(pagetable, sz);
 }
@@ -246,7 +270,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();
 
@@ -261,6 +285,13 @@ fork(void)
     release(&np->lock);
     return -1;
   }
+
+  // increment reference counts on open file descriptors.
+  if(fdcopy(np, p) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
   np->sz = p->sz;
 
   np->parent = p;
@@ -271,11 +302,8 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->tf->a0 = 0;
 
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  tracefork(np, p);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -326,19 +354,15 @@ exit(int status)
     panic("init exiting");
 
   // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  fdcloseall(p);
 
   begin_op(ROOTDEV);
   iput(p->cwd);
   end_op(ROOTDEV);
   p->cwd = 0;
 
+  traceexit(p);
+
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
   // acquired any other proc lock. so wake up init whether that's
@@ -466,6 +490,7 @@ scheduler(void)
         // before jumping back to us.
         p->state = RUNNING;
         c->proc = p;
+        p->usyscall->cpu = cpuid();
         swtch(&c->scheduler, &p->context);
 
         // Process is done running for now.
@@ -596,6 +621,45 @@ wakeup(void *chan)
   }
 }
 
+// Queue the current process on q, to be woken by
+// pollwakeup(q). Caller holds the lock protecting q.
+void
+pollregister(struct pollq *q)
+{
+  q->waiting[myproc() - proc] = 1;
+}
+
+// Ask the current process's poll() to look again at
+// the next clock tick, for a file that may become ready
+// without a pollwakeup(), just by time passing.
+void
+polltick(void)
+{
+  myproc()->polltick = 1;
+}
+
+// Wake the processes queued on q, whether they are
+// asleep in poll() yet or still checking other files.
+// Caller holds the lock protecting q, and no p->lock.
+void
+pollwakeup(struct pollq *q)
+{
+  struct proc *p;
+  int i;
+
+  for(i = 0; i < NPROC; i++){
+    if(q->waiting[i] == 0)
+      continue;
+    q->waiting[i] = 0;
+    p = &proc[i];
+    acquire(&p->lock);
+    p->pollwake = 1;
+    if(p->polling && p->state == SLEEPING)
+      p->state = RUNNABLE;
+    release(&p->lock);
+  }
+}
+
 // Wake up p if it is sleeping in wait(); used by exit().
 // Caller must hold p->lock.
 static void
@@ -662,6 +726,25 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Count process table slots in use, and runnable
+// processes. No lock, like procdump(): the counts
+// are a snapshot for sysinfo().
+void
+procstat(struct sysinfo *si)
+{
+  struct proc *p;
+
+  si->nproc = NPROC;
+  si->procused = 0;
+  si->procrun = 0;
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p->state != UNUSED)
+      si->procused++;
+    if(p->state == RUNNABLE || p->state == RUNNING)
+      si->procrun++;
+  }
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
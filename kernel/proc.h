@@ -82,6 +82,20 @@ struct trapframe {
 
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A process's open files, indexed by file descriptor.
+// The table is kept in pages of NFDPAGE pointers, which
+// are allocated as descriptors in them are first used.
+// The used[] bits mark open descriptors, and full marks
+// used[] words with every bit set, so that the lowest
+// free descriptor can be found in two steps.
+// See fdalloc() in file.c.
+#define NFDPAGE 512  // file pointers per page
+struct fdtable {
+  struct file **page[NOFILE/NFDPAGE];
+  uint64 used[NOFILE/64];
+  uint64 full;
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -93,14 +107,30 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int pollwake;                // an object this process polls changed
+  int polling;                 // sleeping in poll()
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // Page table
   struct trapframe *tf;        // data page for trampoline.S
+  struct uring *uring;         // rings mapped at URING, or 0
+  struct usyscall *usyscall;   // page mapped read-only at USYSCALL
+  int polltick;                // poll() should look again next tick
+  uint64 tracemask;            // system calls to trace (see trace.c)
+  struct tracesess *tracesess; // trace session, if tracemask is set
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable fdt;          // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 };
+
+// The processes waiting in poll() for an object to become
+// ready, indexed like proc[]. Protected by the object's lock.
+// pollwakeup() wakes them and empties the queue, so a
+// process that stops polling the object without being
+// woken stays queued, and may later see one spurious wakeup.
+struct pollq {
+  char waiting[NPROC];
+};
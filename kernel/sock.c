@@ -0,0 +1,417 @@
+//
+// Unix-domain stream sockets.
+//
+// A connected socket reads from one pipe and writes to
+// another, whose other ends belong to its peer, so each
+// connection has its own pair of ring buffers and gets
+// the pipes' watermarks and poll() support for free,
+// without tying up file descriptors for them.
+//
+// socketpair() makes two sockets connected to each other.
+// Otherwise, a server bind()s a socket to a path, which
+// creates a T_SOCK inode there like mknod(), and listen()s
+// on it; connect() on that path finds the listening socket
+// by its inode, connects a new socket to the caller's,
+// and queues it for accept() to return.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "poll.h"
+
+#define BACKLOG 8  // most connections a listener can queue
+
+struct sock {
+  // protected by socktable.lock
+  enum { SOCK_FREE, SOCK_UNBOUND, SOCK_BOUND, SOCK_LISTENING, SOCK_CONNECTED } state;
+  struct pipe *rx;    // connected: read from here
+  struct pipe *tx;    // connected: write to here
+  struct inode *ip;   // bound or listening: the path's inode
+  int backlog;        // listening: connections to queue
+  int npending;       // listening: connections queued
+  int head;           // listening: first in pending
+  struct sock *pending[BACKLOG];
+  int naccept;        // accepters asleep, on &naccept
+  int nconnect;       // connecters asleep, on &nconnect
+  struct pollq pollq; // listening: pollers
+};
+
+struct {
+  struct spinlock lock;
+  struct sock sock[NSOCK];
+} socktable;
+
+void
+sockinit(void)
+{
+  initlock(&socktable.lock, "socktable");
+}
+
+// Allocate an unbound socket. Leaves the sleeper counts,
+// which may still be counting processes that slept on a
+// previous socket in this slot and have yet to wake.
+// Caller holds socktable.lock.
+static struct sock*
+sockalloc(void)
+{
+  struct sock *s;
+
+  for(s = socktable.sock; s < &socktable.sock[NSOCK]; s++){
+    if(s->state == SOCK_FREE){
+      s->state = SOCK_UNBOUND;
+      s->rx = s->tx = 0;
+      s->ip = 0;
+      s->npending = 0;
+      s->head = 0;
+      memset(&s->pollq, 0, sizeof(s->pollq));
+      return s;
+    }
+  }
+  return 0;
+}
+
+// Connect sockets a and b with two new pipes.
+// Caller holds socktable.lock.
+static int
+sockjoin(struct sock *a, struct sock *b)
+{
+  struct pipe *ab, *ba;
+
+  if((ab = pipecreate()) == 0)
+    return -1;
+  if((ba = pipecreate()) == 0){
+    pipeclose(ab, 0);
+    pipeclose(ab, 1);
+    return -1;
+  }
+  a->tx = b->rx = ab;
+  a->rx = b->tx = ba;
+  a->state = b->state = SOCK_CONNECTED;
+  return 0;
+}
+
+// Close a connected socket's ends of its pipes.
+static void
+sockhangup(struct pipe *rx, struct pipe *tx)
+{
+  pipeclose(rx, 0);
+  pipeclose(tx, 1);
+}
+
+// Allocate a file for socket s. On failure, frees s.
+static struct file*
+sockfile(struct sock *s)
+{
+  struct file *f;
+
+  if((f = filealloc()) == 0){
+    sockclose(s);
+    return 0;
+  }
+  f->type = FD_SOCK;
+  f->readable = 1;
+  f->writable = 1;
+  f->sock = s;
+  return f;
+}
+
+// Return a descriptor for a new unbound socket.
+int
+sockopen(void)
+{
+  struct sock *s;
+  struct file *f;
+  int fd;
+
+  acquire(&socktable.lock);
+  s = sockalloc();
+  release(&socktable.lock);
+  if(s == 0 || (f = sockfile(s)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// Make two sockets connected to each other, like pipealloc().
+int
+sockpair(struct file **f0, struct file **f1)
+{
+  struct sock *a, *b;
+
+  *f0 = *f1 = 0;
+  acquire(&socktable.lock);
+  a = sockalloc();
+  b = sockalloc();
+  if(a == 0 || b == 0 || sockjoin(a, b) < 0){
+    if(a)
+      a->state = SOCK_FREE;
+    if(b)
+      b->state = SOCK_FREE;
+    release(&socktable.lock);
+    return -1;
+  }
+  release(&socktable.lock);
+  if((*f0 = sockfile(a)) == 0){
+    sockclose(b);
+    return -1;
+  }
+  if((*f1 = sockfile(b)) == 0){
+    fileclose(*f0);
+    *f0 = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// Is s unbound, so that bind() may create an inode
+// for it? sockbind() checks again.
+int
+sockunbound(struct sock *s)
+{
+  int r;
+
+  acquire(&socktable.lock);
+  r = s->state == SOCK_UNBOUND;
+  release(&socktable.lock);
+  return r;
+}
+
+// Bind s to the T_SOCK inode ip, which the caller
+// has created.
+int
+sockbind(struct sock *s, struct inode *ip)
+{
+  acquire(&socktable.lock);
+  if(s->state != SOCK_UNBOUND){
+    release(&socktable.lock);
+    return -1;
+  }
+  s->ip = idup(ip);
+  s->state = SOCK_BOUND;
+  release(&socktable.lock);
+  return 0;
+}
+
+// Let connect() queue up to n connections on bound socket s.
+int
+socklisten(struct sock *s, int n)
+{
+  acquire(&socktable.lock);
+  if(s->state != SOCK_BOUND && s->state != SOCK_LISTENING){
+    release(&socktable.lock);
+    return -1;
+  }
+  s->state = SOCK_LISTENING;
+  s->backlog = n < 1 ? 1 : n > BACKLOG ? BACKLOG : n;
+  release(&socktable.lock);
+  return 0;
+}
+
+// Connect unbound socket s to the socket listening on
+// inode ip, waiting while its queue is full unless
+// nonblock is set.
+int
+sockconnect(struct sock *s, struct inode *ip, int nonblock)
+{
+  struct sock *l, *c;
+  struct proc *p = myproc();
+
+  acquire(&socktable.lock);
+  for(;;){
+    // look again after sleeping: the listener
+    // may have gone, and its slot been reused.
+    for(l = socktable.sock; l < &socktable.sock[NSOCK]; l++)
+      if(l->state == SOCK_LISTENING && l->ip == ip)
+        break;
+    if(s->state != SOCK_UNBOUND || l == &socktable.sock[NSOCK] || p->killed){
+      release(&socktable.lock);
+      return -1;
+    }
+    if(l->npending < l->backlog)
+      break;
+    if(nonblock){
+      release(&socktable.lock);
+      return -EAGAIN;
+    }
+    l->nconnect++;
+    sleep(&l->nconnect, &socktable.lock);
+    l->nconnect--;
+  }
+  if((c = sockalloc()) == 0){
+    release(&socktable.lock);
+    return -1;
+  }
+  if(sockjoin(s, c) < 0){
+    c->state = SOCK_FREE;
+    release(&socktable.lock);
+    return -1;
+  }
+  l->pending[(l->head + l->npending) % BACKLOG] = c;
+  l->npending++;
+  if(l->naccept > 0)
+    wakeup(&l->naccept);
+  pollwakeup(&l->pollq);
+  release(&socktable.lock);
+  return 0;
+}
+
+// Take the oldest queued connection on listening
+// socket l, waiting for one unless nonblock is set,
+// and return a descriptor for it.
+int
+sockaccept(struct sock *l, int nonblock)
+{
+  struct sock *c;
+  struct file *f;
+  int fd;
+
+  acquire(&socktable.lock);
+  while(l->state == SOCK_LISTENING && l->npending == 0){
+    if(myproc()->killed || nonblock){
+      release(&socktable.lock);
+      return myproc()->killed ? -1 : -EAGAIN;
+    }
+    l->naccept++;
+    sleep(&l->naccept, &socktable.lock);
+    l->naccept--;
+  }
+  if(l->state != SOCK_LISTENING){
+    release(&socktable.lock);
+    return -1;
+  }
+  c = l->pending[l->head];
+  l->head = (l->head + 1) % BACKLOG;
+  l->npending--;
+  if(l->nconnect > 0)
+    wakeup(&l->nconnect);
+  release(&socktable.lock);
+
+  if((f = sockfile(c)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// Free socket s when its file is closed: hang up a
+// connection, or, for a listener, those still queued.
+void
+sockclose(struct sock *s)
+{
+  struct pipe *rx, *tx, *prx[BACKLOG], *ptx[BACKLOG];
+  struct sock *c;
+  struct inode *ip;
+  int i, n;
+
+  acquire(&socktable.lock);
+  rx = tx = 0;
+  if(s->state == SOCK_CONNECTED){
+    rx = s->rx;
+    tx = s->tx;
+  }
+  ip = s->ip;
+  n = 0;
+  if(s->state == SOCK_LISTENING){
+    for(n = 0; n < s->npending; n++){
+      c = s->pending[(s->head + n) % BACKLOG];
+      prx[n] = c->rx;
+      ptx[n] = c->tx;
+      c->state = SOCK_FREE;
+    }
+    wakeup(&s->nconnect);
+    wakeup(&s->naccept);
+    pollwakeup(&s->pollq);
+  }
+  s->state = SOCK_FREE;
+  release(&socktable.lock);
+
+  if(rx)
+    sockhangup(rx, tx);
+  for(i = 0; i < n; i++)
+    sockhangup(prx[i], ptx[i]);
+  if(ip){
+    begin_op(ip->dev);
+    iput(ip);
+    end_op(ip->dev);
+  }
+}
+
+// Return the pipe that connected socket s reads
+// from (if rx) or writes to, or 0 if s isn't connected.
+struct pipe*
+sockpipe(struct sock *s, int rx)
+{
+  struct pipe *pi;
+
+  acquire(&socktable.lock);
+  pi = 0;
+  if(s->state == SOCK_CONNECTED)
+    pi = rx ? s->rx : s->tx;
+  release(&socktable.lock);
+  return pi;
+}
+
+int
+sockreadv(struct sock *s, struct iovec *iov, int iovcnt, int nonblock)
+{
+  struct pipe *pi;
+
+  if((pi = sockpipe(s, 1)) == 0)
+    return -1;
+  return pipereadv(pi, iov, iovcnt, nonblock);
+}
+
+int
+sockwritev(struct sock *s, struct iovec *iov, int iovcnt, int nonblock)
+{
+  struct pipe *pi;
+
+  if((pi = sockpipe(s, 0)) == 0)
+    return -1;
+  return pipewritev(pi, iov, iovcnt, nonblock, 0);
+}
+
+// POLLIN for a listener with connections queued, or
+// else what the connection's pipes say. A socket that is
+// neither is hung up. Queues the caller to hear of changes.
+int
+sockpoll(struct sock *s, int events)
+{
+  struct pipe *rx, *tx;
+  int r;
+
+  acquire(&socktable.lock);
+  if(s->state == SOCK_LISTENING){
+    r = (events & POLLIN) && s->npending > 0 ? POLLIN : 0;
+    pollregister(&s->pollq);
+    release(&socktable.lock);
+    return r;
+  }
+  if(s->state != SOCK_CONNECTED){
+    release(&socktable.lock);
+    return POLLHUP;
+  }
+  rx = s->rx;
+  tx = s->tx;
+  release(&socktable.lock);
+
+  r = 0;
+  if(events & POLLIN)
+    r |= pipepoll(rx, POLLIN);
+  if(events & POLLOUT)
+    r |= pipepoll(tx, POLLOUT);
+  return r;
+}
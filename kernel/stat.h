@@ -1,6 +1,7 @@
 #define T_DIR     1   // Directory
 #define T_FILE    2   // File
 #define T_DEVICE  3   // Device
+#define T_SOCK    4   // Socket bound with bind()
 
 struct stat {
   int dev;     // File system's disk device
@@ -9,3 +10,11 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+struct statfs {
+  uint bsize;  // Block size in bytes
+  uint blocks; // Number of data blocks
+  uint bfree;  // Number of free blocks
+  uint files;  // Number of inodes
+  uint ffree;  // Number of free inodes
+};
@@ -0,0 +1,9 @@
+// One system call in a syscall_batch().
+struct sysop {
+  int num;         // SYS_* number
+  uint64 args[6];  // arguments, as they would be in a0-a5
+  uint64 ret;      // set to the call's return value
+};
+
+#define BATCH_MAX     64  // maximum calls per batch
+#define BATCH_STOPERR 0x1 // stop after the first call that fails
@@ -5,6 +5,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysbatch.h"
+#include "trace.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -105,6 +107,37 @@ extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_ntas(void);
+extern uint64 sys_readdirplus(void);
+extern uint64 sys_statfs(void);
+extern uint64 sys_copy_file_range(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_pipe2(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_uring_setup(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_syscall_batch(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_tracebuf(void);
+extern uint64 sys_tracehist(void);
+extern uint64 sys_sysinfo(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_tee(void);
+extern uint64 sys_vmsplice(void);
+extern uint64 sys_mq_open(void);
+extern uint64 sys_mq_send(void);
+extern uint64 sys_mq_receive(void);
+extern uint64 sys_mq_unlink(void);
+extern uint64 sys_mq_getattr(void);
+extern uint64 sys_socket(void);
+extern uint64 sys_socketpair(void);
+extern uint64 sys_bind(void);
+extern uint64 sys_listen(void);
+extern uint64 sys_accept(void);
+extern uint64 sys_connect(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -129,6 +162,37 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_ntas]    sys_ntas,
+[SYS_readdirplus] sys_readdirplus,
+[SYS_statfs]  sys_statfs,
+[SYS_copy_file_range] sys_copy_file_range,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_poll]    sys_poll,
+[SYS_pipe2]   sys_pipe2,
+[SYS_fcntl]   sys_fcntl,
+[SYS_uring_setup] sys_uring_setup,
+[SYS_uring_enter] sys_uring_enter,
+[SYS_syscall_batch] sys_syscall_batch,
+[SYS_trace]   sys_trace,
+[SYS_tracebuf] sys_tracebuf,
+[SYS_tracehist] sys_tracehist,
+[SYS_sysinfo] sys_sysinfo,
+[SYS_splice]  sys_splice,
+[SYS_tee]     sys_tee,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_mq_open] sys_mq_open,
+[SYS_mq_send] sys_mq_send,
+[SYS_mq_receive] sys_mq_receive,
+[SYS_mq_unlink] sys_mq_unlink,
+[SYS_mq_getattr] sys_mq_getattr,
+[SYS_socket] sys_socket,
+[SYS_socketpair] sys_socketpair,
+[SYS_bind] sys_bind,
+[SYS_listen] sys_listen,
+[SYS_accept] sys_accept,
+[SYS_connect] sys_connect,
 };
 
 void
@@ -139,10 +203,73 @@ syscall(void)
 
   num = p->tf->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
-    p->tf->a0 = syscalls[num]();
+    if(num < NTRACESYS && (p->tracemask & (1UL << num))){
+      uint64 start = r_time();
+      p->tf->a0 = syscalls[num]();
+      tracerecord(p, num, p->tf->a0, start);
+    } else {
+      p->tf->a0 = syscalls[num]();
+    }
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
     p->tf->a0 = -1;
   }
 }
+
+// Run the n system calls described by the user array of
+// struct sysop at ops in a single kernel entry, storing each
+// call's return value in its ret. With BATCH_STOPERR in
+// flags, stops after the first call that returns a negative
+// value. Returns the number of calls run.
+// Each call finds its arguments in the trapframe as usual;
+// they are swapped in for it, and the batch's own restored
+// afterwards. Calls that replace or end the process, or
+// that depend on the trapframe in other ways, can't be
+// batched and fail with -1.
+uint64
+sys_syscall_batch(void)
+{
+  struct proc *p = myproc();
+  struct sysop op;
+  uint64 uops, a[6];
+  int i, n, flags;
+
+  if(argaddr(0, &uops) < 0 || argint(1, &n) < 0 || argint(2, &flags) < 0)
+    return -1;
+  if(n < 0 || n > BATCH_MAX)
+    return -1;
+
+  for(i = 0; i < 6; i++)
+    a[i] = argraw(i);
+  for(i = 0; i < n && !p->killed; i++){
+    if(copyin(p->pagetable, (char*)&op, uops + i*sizeof(op), sizeof(op)) < 0)
+      break;
+    if(op.num <= 0 || op.num >= NELEM(syscalls) || syscalls[op.num] == 0 ||
+       op.num == SYS_fork || op.num == SYS_exit || op.num == SYS_exec ||
+       op.num == SYS_syscall_batch){
+      op.ret = -1;
+    } else {
+      p->tf->a0 = op.args[0];
+      p->tf->a1 = op.args[1];
+      p->tf->a2 = op.args[2];
+      p->tf->a3 = op.args[3];
+      p->tf->a4 = op.args[4];
+      p->tf->a5 = op.args[5];
+      op.ret = syscalls[op.num]();
+    }
+    if(copyout(p->pagetable, uops + i*sizeof(op), (char*)&op, sizeof(op)) < 0)
+      break;
+    if((flags & BATCH_STOPERR) && (int)op.ret < 0){
+      i++;
+      break;
+    }
+  }
+  p->tf->a0 = a[0];
+  p->tf->a1 = a[1];
+  p->tf->a2 = a[2];
+  p->tf->a3 = a[3];
+  p->tf->a4 = a[4];
+  p->tf->a5 = a[5];
+  return i;
+}
@@ -23,3 +23,34 @@
 
 // System calls for labs
 #define SYS_ntas   22
+#define SYS_readdirplus 23
+#define SYS_statfs 24
+#define SYS_copy_file_range 25
+#define SYS_pread  26
+#define SYS_pwrite 27
+#define SYS_readv  28
+#define SYS_writev 29
+#define SYS_poll   30
+#define SYS_pipe2  31
+#define SYS_fcntl  32
+#define SYS_uring_setup 33
+#define SYS_uring_enter 34
+#define SYS_syscall_batch 35
+#define SYS_trace  36
+#define SYS_tracebuf 37
+#define SYS_tracehist 38
+#define SYS_sysinfo 39
+#define SYS_splice 40
+#define SYS_tee    41
+#define SYS_vmsplice 42
+#define SYS_mq_open 43
+#define SYS_mq_send 44
+#define SYS_mq_receive 45
+#define SYS_mq_unlink 46
+#define SYS_mq_getattr 47
+#define SYS_socket 48
+#define SYS_socketpair 49
+#define SYS_bind 50
+#define SYS_listen 51
+#define SYS_accept 52
+#define SYS_connect 53
@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "poll.h"
+#include "mqueue.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +29,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f=fdget(myproc(), fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,21 +38,29 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
+// Fetch the nth and n+1th word-sized system call arguments
+// as a user array of iovecs and its length, and copy the
+// array into iov, which has room for IOV_MAX entries.
 static int
-fdalloc(struct file *f)
+argiov(int n, struct iovec *iov, int *piovcnt)
 {
-  int fd;
-  struct proc *p = myproc();
+  uint64 uiov, tot;
+  int iovcnt, k;
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
+  if(argaddr(n, &uiov) < 0 || argint(n+1, &iovcnt) < 0)
+    return -1;
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, iovcnt*sizeof(struct iovec)) < 0)
+    return -1;
+  // the total must fit in the int that is returned.
+  tot = 0;
+  for(k = 0; k < iovcnt; k++){
+    if(iov[k].iov_len > 0x7fffffff || (tot += iov[k].iov_len) > 0x7fffffff)
+      return -1;
   }
-  return -1;
+  *piovcnt = iovcnt;
+  return 0;
 }
 
 uint64
@@ -91,6 +102,154 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt);
+}
+
+// Like writev() to a pipe, but whole pages are given to
+// the pipe copy-on-write instead of being copied.
+uint64
+sys_vmsplice(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  if(f->type != FD_PIPE || f->writable == 0)
+    return -1;
+  return pipewritev(f->pipe, iov, iovcnt, f->nonblock, 1);
+}
+
+// Wait until one of the nfds descriptors in fds is ready
+// for the events it asks about, or for timeout clock ticks
+// (forever if timeout is negative). Returns the number of
+// descriptors with revents set, 0 on timeout.
+uint64
+sys_poll(void)
+{
+  struct pollfd *fds;
+  struct proc *p = myproc();
+  struct file *f;
+  uint64 ufds;
+  uint ticks0;
+  int i, n, nfds, timeout;
+
+  if(argaddr(0, &ufds) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > PGSIZE/sizeof(struct pollfd))
+    return -1;
+  if((fds = (struct pollfd*)kalloc()) == 0)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, ufds, nfds*sizeof(struct pollfd)) < 0){
+    kfree((char*)fds);
+    return -1;
+  }
+
+  acquire(&tickslock);
+  ticks0 = ticks;
+  release(&tickslock);
+
+  for(;;){
+    // anything that changes from here on sets p->pollwake,
+    // because filepoll() queues us before it looks.
+    acquire(&p->lock);
+    p->pollwake = 0;
+    release(&p->lock);
+    p->polltick = 0;
+
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if((f = fdget(p, fds[i].fd)) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f, fds[i].events);
+      if(fds[i].revents)
+        n++;
+    }
+    if(n > 0 || timeout == 0)
+      break;
+
+    acquire(&tickslock);
+    if(timeout > 0 && ticks - ticks0 >= timeout){
+      release(&tickslock);
+      break;
+    }
+    release(&tickslock);
+
+    acquire(&p->lock);
+    if(p->killed){
+      release(&p->lock);
+      kfree((char*)fds);
+      return -1;
+    }
+    // with a timeout, or a file that asked with
+    // polltick(), also wake on every clock tick to check.
+    p->polling = 1;
+    if(p->pollwake == 0)
+      sleep(timeout > 0 || p->polltick ? (void*)&ticks : (void*)&p->pollwake, &p->lock);
+    p->polling = 0;
+    release(&p->lock);
+  }
+
+  if(copyout(p->pagetable, ufds, (char*)fds, nfds*sizeof(struct pollfd)) < 0)
+    n = -1;
+  kfree((char*)fds);
+  return n;
+}
+
+// Read from fd at a given offset, leaving the
+// descriptor's own offset alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+// Write to fd at a given offset, leaving the
+// descriptor's own offset alone.
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
 uint64
 sys_close(void)
 {
@@ -99,7 +258,7 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  fdclear(myproc(), fd);
   fileclose(f);
   return 0;
 }
@@ -115,6 +274,75 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Read directory entries together with the stat
+// information of the inodes they name.
+uint64
+sys_readdirplus(void)
+{
+  struct file *f;
+  int n;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return filereaddir(f, p, n);
+}
+
+// Report free and total blocks and inodes of the
+// root file system.
+uint64
+sys_statfs(void)
+{
+  uint64 addr; // user pointer to struct statfs
+  struct statfs st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  fsstat(ROOTDEV, &st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Copy n bytes from one file to another without
+// going through user space.
+uint64
+sys_copy_file_range(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filecopy(in, out, n);
+}
+
+// Move up to n bytes between a pipe and another file,
+// or another pipe, without going through user space.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n, 0);
+}
+
+// Copy up to n bytes from one pipe to another,
+// leaving them in the first.
+uint64
+sys_tee(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n, 1);
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -287,13 +515,21 @@ uint64
 sys_open(void)
 {
   char path[MAXPATH];
-  int fd, omode;
-  struct file *f;
-  struct inode *ip;
-  int n;
+  int omode;
 
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
     return -1;
+  return fileopen(path, omode);
+}
+
+// Open path in the current process, as open() does, and
+// return the new file descriptor or -1.
+int
+fileopen(char *path, int omode)
+{
+  int fd;
+  struct file *f;
+  struct inode *ip;
 
   begin_op(ROOTDEV);
 
@@ -309,14 +545,15 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & (O_WRONLY|O_RDWR|O_CREATE))){
       iunlockput(ip);
       end_op(ROOTDEV);
       return -1;
     }
   }
 
-  if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
+  if((ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)) ||
+     ip->type == T_SOCK){
     iunlockput(ip);
     end_op(ROOTDEV);
     return -1;
@@ -341,6 +578,7 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   iunlock(ip);
   end_op(ROOTDEV);
@@ -452,30 +690,27 @@ sys_exec(void)
   return -1;
 }
 
-uint64
-sys_pipe(void)
+// Allocate descriptors for the two files rf and wf, and
+// store them in the user array fdarray. On failure,
+// closes the files.
+static int
+fdpair(uint64 fdarray, struct file *rf, struct file *wf)
 {
-  uint64 fdarray; // user pointer to array of two integers
-  struct file *rf, *wf;
   int fd0, fd1;
   struct proc *p = myproc();
 
-  if(argaddr(0, &fdarray) < 0)
-    return -1;
-  if(pipealloc(&rf, &wf) < 0)
-    return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdclear(p, fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdclear(p, fd0);
+    fdclear(p, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -483,3 +718,295 @@ sys_pipe(void)
   return 0;
 }
 
+// Create a pipe, and store its read and write
+// descriptors in the user array fdarray.
+// flags may hold O_NONBLOCK, for both ends.
+static int
+pipefds(uint64 fdarray, int flags)
+{
+  struct file *rf, *wf;
+
+  if(flags & ~O_NONBLOCK)
+    return -1;
+  if(pipealloc(&rf, &wf) < 0)
+    return -1;
+  rf->nonblock = wf->nonblock = (flags & O_NONBLOCK) != 0;
+  return fdpair(fdarray, rf, wf);
+}
+
+uint64
+sys_pipe(void)
+{
+  uint64 fdarray; // user pointer to array of two integers
+
+  if(argaddr(0, &fdarray) < 0)
+    return -1;
+  return pipefds(fdarray, 0);
+}
+
+uint64
+sys_pipe2(void)
+{
+  uint64 fdarray;
+  int flags;
+
+  if(argaddr(0, &fdarray) < 0 || argint(1, &flags) < 0)
+    return -1;
+  return pipefds(fdarray, flags);
+}
+
+// The pipe that fcntl()'s pipe commands apply to: a
+// pipe's own, or the one a connected socket reads from
+// (if rx) or writes to.
+static struct pipe*
+fcntlpipe(struct file *f, int rx)
+{
+  if(f->type == FD_PIPE)
+    return f->pipe;
+  if(f->type == FD_SOCK)
+    return sockpipe(f->sock, rx);
+  return 0;
+}
+
+// Get or set a descriptor's flags, of which only
+// O_NONBLOCK can be changed, or a pipe's buffer size
+// and watermarks. For a socket, the buffer size is
+// that of the pipe it receives into, the reader
+// watermark is for that pipe, and the writer
+// watermark for the one it sends into.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  struct pipe *pi;
+  int cmd, arg, fl;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETFL:
+    if(f->readable && f->writable)
+      fl = O_RDWR;
+    else if(f->writable)
+      fl = O_WRONLY;
+    else
+      fl = O_RDONLY;
+    if(f->nonblock)
+      fl |= O_NONBLOCK;
+    return fl;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  case F_SETPIPE_SZ:
+    if((pi = fcntlpipe(f, 1)) == 0)
+      return -1;
+    return pipesetsize(pi, arg);
+  case F_GETPIPE_SZ:
+    if((pi = fcntlpipe(f, 1)) == 0)
+      return -1;
+    return pipesize(pi);
+  case F_SETPIPE_RLOWAT:
+  case F_SETPIPE_WLOWAT:
+    if((pi = fcntlpipe(f, cmd == F_SETPIPE_RLOWAT)) == 0)
+      return -1;
+    return pipesetlowat(pi, cmd == F_SETPIPE_RLOWAT, arg);
+  }
+  return -1;
+}
+
+
+// Return in *pf the open message queue file for
+// argument n, if the caller may use it that way.
+static int
+argmq(int n, struct file **pf, int write)
+{
+  struct file *f;
+
+  if(argfd(n, 0, &f) < 0 || f->type != FD_MQ)
+    return -1;
+  if(write ? !f->writable : !f->readable)
+    return -1;
+  *pf = f;
+  return 0;
+}
+
+// Open, or create, a message queue. The attributes
+// pointer may be 0 for the defaults.
+uint64
+sys_mq_open(void)
+{
+  char name[MQ_NAMESIZE];
+  int omode;
+  uint64 addr; // user pointer to struct mq_attr
+  struct mq_attr attr;
+
+  if(argstr(0, name, MQ_NAMESIZE) < 0 || argint(1, &omode) < 0 || argaddr(2, &addr) < 0)
+    return -1;
+  if(addr && copyin(myproc()->pagetable, (char *)&attr, addr, sizeof(attr)) < 0)
+    return -1;
+  return mqopen(name, omode, addr ? &attr : 0);
+}
+
+uint64
+sys_mq_send(void)
+{
+  struct file *f;
+  uint64 addr;
+  int n, prio;
+
+  if(argmq(0, &f, 1) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0 || argint(3, &prio) < 0)
+    return -1;
+  return mqsend(f->mq, addr, n, prio, f->nonblock);
+}
+
+uint64
+sys_mq_receive(void)
+{
+  struct file *f;
+  uint64 addr, paddr;
+  int n, prio, r;
+
+  if(argmq(0, &f, 0) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0 || argaddr(3, &paddr) < 0)
+    return -1;
+  if((r = mqreceive(f->mq, addr, n, &prio, f->nonblock)) < 0)
+    return r;
+  if(paddr && copyout(myproc()->pagetable, paddr, (char *)&prio, sizeof(prio)) < 0)
+    return -1;
+  return r;
+}
+
+uint64
+sys_mq_unlink(void)
+{
+  char name[MQ_NAMESIZE];
+
+  if(argstr(0, name, MQ_NAMESIZE) < 0)
+    return -1;
+  return mqunlink(name);
+}
+
+uint64
+sys_mq_getattr(void)
+{
+  struct file *f;
+  uint64 addr; // user pointer to struct mq_attr
+  struct mq_attr attr;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_MQ || argaddr(1, &addr) < 0)
+    return -1;
+  mqstat(f->mq, &attr);
+  attr.mq_flags = f->nonblock ? O_NONBLOCK : 0;
+  if(copyout(myproc()->pagetable, addr, (char *)&attr, sizeof(attr)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_socket(void)
+{
+  return sockopen();
+}
+
+uint64
+sys_socketpair(void)
+{
+  uint64 fdarray; // user pointer to array of two integers
+  struct file *f0, *f1;
+
+  if(argaddr(0, &fdarray) < 0)
+    return -1;
+  if(sockpair(&f0, &f1) < 0)
+    return -1;
+  return fdpair(fdarray, f0, f1);
+}
+
+// Return in *pf the socket file for argument n.
+static int
+argsock(int n, struct file **pf)
+{
+  struct file *f;
+
+  if(argfd(n, 0, &f) < 0 || f->type != FD_SOCK)
+    return -1;
+  *pf = f;
+  return 0;
+}
+
+// Create a T_SOCK inode at path, and bind
+// the socket to it.
+uint64
+sys_bind(void)
+{
+  char path[MAXPATH];
+  struct file *f;
+  struct inode *ip;
+  int r;
+
+  if(argsock(0, &f) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  if(!sockunbound(f->sock))
+    return -1;  // don't leave an inode behind
+  begin_op(ROOTDEV);
+  if((ip = create(path, T_SOCK, 0, 0)) == 0){
+    end_op(ROOTDEV);
+    return -1;
+  }
+  r = sockbind(f->sock, ip);
+  iunlockput(ip);
+  end_op(ROOTDEV);
+  return r;
+}
+
+uint64
+sys_listen(void)
+{
+  struct file *f;
+  int n;
+
+  if(argsock(0, &f) < 0 || argint(1, &n) < 0)
+    return -1;
+  return socklisten(f->sock, n);
+}
+
+uint64
+sys_accept(void)
+{
+  struct file *f;
+
+  if(argsock(0, &f) < 0)
+    return -1;
+  return sockaccept(f->sock, f->nonblock);
+}
+
+// Connect to the socket listening on path.
+uint64
+sys_connect(void)
+{
+  char path[MAXPATH];
+  struct file *f;
+  struct inode *ip;
+  int r;
+
+  if(argsock(0, &f) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  begin_op(ROOTDEV);
+  if((ip = namei(path)) == 0){
+    end_op(ROOTDEV);
+    return -1;
+  }
+  ilock(ip);
+  if(ip->type != T_SOCK){
+    iunlockput(ip);
+    end_op(ROOTDEV);
+    return -1;
+  }
+  iunlock(ip);
+  end_op(ROOTDEV);
+  // ip's reference keeps it in the inode cache, so
+  // a listener bound to it still has the same pointer.
+  r = sockconnect(f->sock, ip, f->nonblock);
+  begin_op(ROOTDEV);
+  iput(ip);
+  end_op(ROOTDEV);
+  return r;
+}
@@ -0,0 +1,15 @@
+// System state reported by the sysinfo() system call.
+struct sysinfo {
+  int freepages;  // free pages of physical memory
+  int nproc;      // process table slots
+  int procused;   // slots in use
+  int procrun;    // of those, runnable or running
+  int nbuf;       // buffer cache blocks
+  int bufused;    // buffers referenced right now
+  int bufvalid;   // buffers holding a disk block
+  int ninode;     // inode cache entries
+  int inodeused;  // entries referenced
+  int logsize;    // blocks the root device's log can hold
+  int logused;    // blocks in the current transaction
+  int logops;     // FS system calls in the current transaction
+};
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sysinfo.h"
 
 uint64
 sys_exit(void)
@@ -95,3 +96,24 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Report free memory and the state of the
+// process table, caches and log.
+uint64
+sys_sysinfo(void)
+{
+  uint64 addr; // user pointer to struct sysinfo
+  struct sysinfo si;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  si.freepages = kfreepages();
+  procstat(&si);
+  bcachestat(&si);
+  icachestat(&si);
+  log_stat(ROOTDEV, &si);
+  if(copyout(myproc()->pagetable, addr, (char *)&si, sizeof(si)) < 0)
+    return -1;
+  return 0;
+}
+
@@ -0,0 +1,267 @@
+//
+// System call tracing.
+//
+// trace(mask) makes syscall() time the calling process's system
+// calls whose numbers are set in mask, and starts a trace session
+// named by the caller's pid; children inherit the mask and the
+// session. Each traced call is added to its session's latency
+// histogram for its number, and recorded in a ring belonging to
+// the CPU it returned on.
+//
+// Only that CPU writes its ring, with interrupts off, so recording
+// a call takes no lock. When a ring wraps, the oldest entries are
+// overwritten. Each session reads every ring from its own tail,
+// so tracebuf() drains only the calls of the session it is asked
+// about, leaving other sessions' to their own tracers. It checks
+// each entry's sequence number before and after copying it, so
+// that an entry that was overwritten meanwhile is skipped rather
+// than returned half-written.
+//
+// A session outlives its processes, so that a tracer can drain it
+// and read its histograms after the traced command has exited, until
+// trace() needs its slot for a new session.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+
+struct traceslot {
+  uint64 seq;  // index+1 of the entry held, or 0 while it is written
+  int sess;    // id of the entry's session
+  struct traceent e;
+};
+
+struct tracering {
+  uint64 head;  // entries ever recorded; written by the owning CPU
+  struct traceslot slot[NTRACE];
+} tracering[NCPU];
+
+// all but hist are protected by tracelock.
+struct tracesess {
+  int id;       // unique among sessions ever started
+  int leader;   // pid of the process that started it, or 0
+  int ref;      // processes in it; free if 0
+  uint64 tail[NCPU];  // next entry to look at in each CPU's ring
+  uint64 hist[NTRACESYS][NHIST];
+} tracesess[NTRACESESS];
+
+struct spinlock tracelock;
+int nextsess = 1;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Record a traced system call that syscall() has just run.
+void
+tracerecord(struct proc *p, int num, uint64 ret, uint64 start)
+{
+  struct tracering *r;
+  struct traceslot *s;
+  uint64 end, d, idx;
+  int b;
+
+  end = r_time();
+  for(b = 0, d = (end - start) >> 1; d && b < NHIST-1; b++)
+    d >>= 1;
+  __sync_fetch_and_add(&p->tracesess->hist[num][b], 1);
+
+  push_off();
+  r = &tracering[cpuid()];
+  idx = r->head;
+  s = &r->slot[idx % NTRACE];
+  s->seq = 0;
+  __sync_synchronize();
+  s->sess = p->tracesess->id;
+  s->e.pid = p->pid;
+  s->e.num = num;
+  s->e.ret = ret;
+  s->e.start = start;
+  s->e.end = end;
+  __sync_synchronize();
+  s->seq = idx + 1;
+  r->head = idx + 1;
+  pop_off();
+}
+
+// Drop a process's reference to session s, if any.
+// Caller holds tracelock.
+static void
+traceput(struct tracesess *s)
+{
+  if(s)
+    s->ref--;
+}
+
+// Make fork()'s child np trace what its parent p does.
+void
+tracefork(struct proc *np, struct proc *p)
+{
+  acquire(&tracelock);
+  np->tracemask = p->tracemask;
+  np->tracesess = p->tracesess;
+  if(np->tracesess)
+    np->tracesess->ref++;
+  release(&tracelock);
+}
+
+// Take exiting process p out of its session.
+void
+traceexit(struct proc *p)
+{
+  acquire(&tracelock);
+  traceput(p->tracesess);
+  p->tracesess = 0;
+  p->tracemask = 0;
+  release(&tracelock);
+}
+
+// Find the session started by process pid.
+// Caller holds tracelock.
+static struct tracesess*
+tracefind(int pid)
+{
+  struct tracesess *s;
+
+  for(s = tracesess; s < &tracesess[NTRACESESS]; s++)
+    if(pid > 0 && s->leader == pid)
+      return s;
+  return 0;
+}
+
+// Set the calling process's trace mask. Unless the caller
+// already leads a session, a non-zero mask starts a new one,
+// leaving any it inherited; a zero mask leaves its session.
+uint64
+sys_trace(void)
+{
+  struct proc *p = myproc();
+  struct tracesess *s, *old;
+  uint64 mask;
+  int i;
+
+  if(argaddr(0, &mask) < 0)
+    return -1;
+  acquire(&tracelock);
+  s = p->tracesess;
+  if(mask && (s == 0 || s->leader != p->pid)){
+    for(s = tracesess; s < &tracesess[NTRACESESS]; s++)
+      if(s->ref == 0)
+        break;
+    if(s == &tracesess[NTRACESESS]){
+      release(&tracelock);
+      return -1;
+    }
+    if((old = tracefind(p->pid)) != 0)
+      old->leader = 0;  // an earlier session of the caller's
+    traceput(p->tracesess);
+    s->id = nextsess++;
+    s->leader = p->pid;
+    s->ref = 1;
+    for(i = 0; i < NCPU; i++)
+      s->tail[i] = tracering[i].head;
+    memset(s->hist, 0, sizeof(s->hist));
+    p->tracesess = s;
+  } else if(mask == 0){
+    traceput(s);
+    p->tracesess = 0;
+  }
+  p->tracemask = mask;
+  release(&tracelock);
+  return 0;
+}
+
+// Take up to n of session s's recorded calls, from
+// all CPUs, into e. Returns the number taken.
+// Caller holds tracelock.
+static int
+tracetake(struct tracesess *s, struct traceent *e, int n)
+{
+  struct tracering *r;
+  struct traceslot *sl;
+  uint64 head, seq;
+  int i, got, sess;
+
+  got = 0;
+  for(i = 0; i < NCPU && got < n; i++){
+    r = &tracering[i];
+    head = r->head;
+    if(head - s->tail[i] > NTRACE)
+      s->tail[i] = head - NTRACE;  // the rest were overwritten
+    for(; s->tail[i] < head && got < n; s->tail[i]++){
+      sl = &r->slot[s->tail[i] % NTRACE];
+      seq = sl->seq;
+      __sync_synchronize();
+      sess = sl->sess;
+      e[got] = sl->e;
+      __sync_synchronize();
+      if(seq != s->tail[i] + 1 || sl->seq != seq || sess != s->id)
+        continue;
+      got++;
+    }
+  }
+  return got;
+}
+
+// Drain up to n recorded calls of the session started by
+// process pid into the user array of struct traceent at addr.
+// Returns the number drained. The entries are gathered a few
+// at a time under tracelock, and copied out without it.
+uint64
+sys_tracebuf(void)
+{
+  struct proc *p = myproc();
+  struct tracesess *s;
+  struct traceent e[16];
+  uint64 addr;
+  int pid, n, got, k;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+
+  for(got = 0; got < n; got += k){
+    acquire(&tracelock);
+    k = 0;
+    if((s = tracefind(pid)) != 0)
+      k = tracetake(s, e, n - got < NELEM(e) ? n - got : NELEM(e));
+    release(&tracelock);
+    if(s == 0)
+      return -1;
+    if(k == 0)
+      break;
+    if(copyout(p->pagetable, addr + got*sizeof(e[0]), (char*)e, k*sizeof(e[0])) < 0)
+      return -1;
+  }
+  return got;
+}
+
+// Copy system call num's latency histogram, NHIST counts,
+// for the session started by process pid, to the user
+// array at addr.
+uint64
+sys_tracehist(void)
+{
+  struct tracesess *s;
+  uint64 addr, hist[NHIST];
+  int pid, num;
+
+  if(argint(0, &pid) < 0 || argint(1, &num) < 0 || argaddr(2, &addr) < 0)
+    return -1;
+  if(num < 0 || num >= NTRACESYS)
+    return -1;
+  acquire(&tracelock);
+  if((s = tracefind(pid)) == 0){
+    release(&tracelock);
+    return -1;
+  }
+  memmove(hist, s->hist[num], sizeof(hist));
+  release(&tracelock);
+  return copyout(myproc()->pagetable, addr, (char*)hist, sizeof(hist));
+}
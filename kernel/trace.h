@@ -0,0 +1,17 @@
+// System call tracing (see kernel/trace.c).
+
+// One traced system call, as returned by tracebuf().
+struct traceent {
+  int pid;
+  int num;        // SYS_* number
+  uint64 ret;     // return value
+  uint64 start;   // time CSR on entry
+  uint64 end;     // time CSR on return
+};
+
+#define NTRACESYS 64  // system call numbers a trace mask can hold
+#define NTRACE   128  // entries in each CPU's ring
+#define NTRACESESS 4  // trace sessions kept at once
+#define NHIST     20  // latency histogram buckets; bucket i counts
+                      // calls of [2^i, 2^(i+1)) time CSR cycles,
+                      // and the last also every longer call
@@ -8,6 +8,7 @@
 
 struct spinlock tickslock;
 uint ticks;
+uint64 timebase;  // time CSR when ticks started
 
 extern char trampoline[], uservec[], userret[];
 
@@ -23,6 +24,7 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  timebase = r_time();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -68,6 +70,9 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && r_stval() < p->sz &&
+            uvmcow(p->pagetable, PGROUNDDOWN(r_stval())) > 0){
+    // store to a copy-on-write page; it's writable now.
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -161,11 +166,14 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// ticks is worked out from the time CSR rather than counted,
+// so that timer interrupts that qemu coalesces aren't lost,
+// and so that it agrees with uuptime() in user/ulib.c.
 void
 clockintr()
 {
   acquire(&tickslock);
-  ticks++;
+  ticks = (r_time() - timebase) / TICKINTERVAL;
   wakeup(&ticks);
   release(&tickslock);
 }
@@ -191,6 +199,8 @@ devintr()
       uartintr();
     } else if(irq == VIRTIO0_IRQ || irq == VIRTIO1_IRQ ){
       virtio_disk_intr(irq - VIRTIO0_IRQ);
+    } else if(irq == VIRTIO2_IRQ){
+      virtio_cons_intr();
     } else {
       // the PLIC sends each device interrupt to every core,
       // which generates a lot of interrupts with irq==0.
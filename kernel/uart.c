@@ -22,14 +22,34 @@
 #define RHR 0 // receive holding register (for input bytes)
 #define THR 0 // transmit holding register (for output bytes)
 #define IER 1 // interrupt enable register
+#define IER_RX_ENABLE (1<<0)
+#define IER_TX_ENABLE (1<<1)
 #define FCR 2 // FIFO control register
 #define ISR 2 // interrupt status register
 #define LCR 3 // line control register
 #define LSR 5 // line status register
+#define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
+#define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
 
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
+// the transmit output buffer. uartwrite() adds to it,
+// and uartstart() hands it to the UART a character at
+// a time, each time the UART says it is ready for one.
+struct {
+  struct spinlock lock;
+#define UART_TX_BUF_SIZE 32
+  char buf[UART_TX_BUF_SIZE];
+  uint w;      // write index: characters added
+  uint r;      // read index: characters sent
+  int nsleep;  // writers asleep on r, waiting for room
+} uart_tx;
+
+extern volatile int panicked; // from printf.c
+
+void uartstart(void);
+
 void
 uartinit(void)
 {
@@ -52,18 +72,88 @@ uartinit(void)
   // reset and enable FIFOs.
   WriteReg(FCR, 0x07);
 
-  // enable receive interrupts.
-  WriteReg(IER, 0x01);
+  // enable transmit and receive interrupts.
+  WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+
+  initlock(&uart_tx.lock, "uart");
+}
+
+// add the n characters at buf to the output buffer, in
+// order, and tell the UART to start sending if it isn't
+// already. waits only while the buffer is full, so it may
+// sleep, and so can't be called from interrupts; those use
+// uartputc_sync(). sleeping releases uart_tx.lock, so
+// another writer's characters may come between those
+// added before and after the wait.
+void
+uartwrite(char *buf, int n)
+{
+  int i;
+
+  acquire(&uart_tx.lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+
+  for(i = 0; i < n; i++){
+    while(uart_tx.w == uart_tx.r + UART_TX_BUF_SIZE){
+      // buffer is full. get the UART going on it,
+      // and wait for uartstart() to make room.
+      uartstart();
+      uart_tx.nsleep++;
+      sleep(&uart_tx.r, &uart_tx.lock);
+      uart_tx.nsleep--;
+    }
+    uart_tx.buf[uart_tx.w++ % UART_TX_BUF_SIZE] = buf[i];
+  }
+  uartstart();
+  release(&uart_tx.lock);
 }
 
-// write one output character to the UART.
+// write one output character to the UART, spinning
+// until it can take it, ahead of anything buffered.
+// for kernel printf() and for echoing input, which
+// must not sleep.
 void
-uartputc(int c)
+uartputc_sync(int c)
 {
+  push_off();
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+
   // wait for Transmit Holding Empty to be set in LSR.
-  while((ReadReg(LSR) & (1 << 5)) == 0)
+  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
     ;
   WriteReg(THR, c);
+
+  pop_off();
+}
+
+// if the UART is idle and there is output buffered,
+// send the next character. the UART interrupts when it
+// is ready for another, and uartintr() calls here again.
+// caller holds uart_tx.lock; called from both the top
+// and bottom halves.
+void
+uartstart(void)
+{
+  while(uart_tx.r != uart_tx.w){
+    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+      // the UART transmit holding register is full;
+      // it will interrupt when it's ready for more.
+      return;
+    }
+    WriteReg(THR, uart_tx.buf[uart_tx.r++ % UART_TX_BUF_SIZE]);
+
+    // maybe uartwrite() is waiting for room.
+    if(uart_tx.nsleep > 0)
+      wakeup(&uart_tx.r);
+  }
 }
 
 // read one input character from the UART.
@@ -71,7 +161,7 @@ uartputc(int c)
 int
 uartgetc(void)
 {
-  if(ReadReg(LSR) & 0x01){
+  if(ReadReg(LSR) & LSR_RX_READY){
     // input data is ready.
     return ReadReg(RHR);
   } else {
@@ -79,14 +169,25 @@ uartgetc(void)
   }
 }
 
-// trap.c calls here when the uart interrupts.
+// trap.c calls here when the uart interrupts,
+// because input has arrived, or the uart is
+// ready for more output, or both.
 void
 uartintr(void)
 {
+  // acknowledge the interrupt.
+  ReadReg(ISR);
+
+  // read and process incoming characters.
   while(1){
     int c = uartgetc();
     if(c == -1)
       break;
     consoleintr(c);
   }
+
+  // send buffered characters.
+  acquire(&uart_tx.lock);
+  uartstart();
+  release(&uart_tx.lock);
 }
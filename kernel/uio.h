@@ -0,0 +1,7 @@
+// One buffer of a readv() or writev() call.
+struct iovec {
+  void *iov_base; // Start of the buffer (a user address)
+  uint64 iov_len; // Length of the buffer in bytes
+};
+
+#define IOV_MAX 16  // maximum buffers per readv() or writev()
@@ -0,0 +1,130 @@
+//
+// Submission and completion rings for batching system calls.
+//
+// uring_setup() maps one page at URING in the calling process,
+// holding a struct uring. The process queues operations in the
+// submission ring, and a single uring_enter() runs up to the
+// requested number of them and posts their results in the
+// completion ring, with one trap for the whole batch.
+//
+// xv6 has no kernel threads to run the operations
+// asynchronously, so uring_enter() runs them itself, in order,
+// before it returns.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "uring.h"
+
+// Unmap and free p's rings, if it has any.
+// Called by exec(), which drops them, and freeproc().
+void
+uringfree(struct proc *p)
+{
+  if(p->uring == 0)
+    return;
+  uvmunmap(p->pagetable, URING, PGSIZE, 0);
+  kfree((void*)p->uring);
+  p->uring = 0;
+}
+
+// Run one submission, and return what the
+// corresponding system call would have.
+static int
+uringop(struct uring_sqe *sqe)
+{
+  struct proc *p = myproc();
+  char path[MAXPATH];
+  struct file *f;
+
+  if(sqe->op == URING_NOP)
+    return 0;
+  if(sqe->op == URING_OPEN){
+    if(fetchstr(sqe->addr, path, MAXPATH) < 0)
+      return -1;
+    return fileopen(path, sqe->len);
+  }
+
+  if((f = fdget(p, sqe->fd)) == 0)
+    return -1;
+  switch(sqe->op){
+  case URING_READ:
+    if(sqe->off < 0)
+      return fileread(f, sqe->addr, sqe->len);
+    return filepread(f, sqe->addr, sqe->len, sqe->off);
+  case URING_WRITE:
+    if(sqe->off < 0)
+      return filewrite(f, sqe->addr, sqe->len);
+    return filepwrite(f, sqe->addr, sqe->len, sqe->off);
+  case URING_CLOSE:
+    fdclear(p, sqe->fd);
+    fileclose(f);
+    return 0;
+  case URING_FSYNC:
+    return filesync(f);
+  }
+  return -1;
+}
+
+// Map a zeroed ring page at URING.
+// Returns URING, or -1 if the process already has rings.
+uint64
+sys_uring_setup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(p->uring)
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  p->uring = (struct uring*)mem;
+  return URING;
+}
+
+// Run up to n queued submissions, stopping early if the
+// submission ring empties or the completion ring fills.
+// Returns the number run.
+uint64
+sys_uring_enter(void)
+{
+  struct proc *p = myproc();
+  struct uring *r = p->uring;
+  struct uring_sqe sqe;
+  struct uring_cqe *cqe;
+  int n, done;
+
+  if(argint(0, &n) < 0 || r == 0)
+    return -1;
+
+  for(done = 0; done < n && !p->killed; done++){
+    if(r->sq_head == r->sq_tail)
+      break;
+    if(r->cq_tail - r->cq_head >= URING_ENTRIES)
+      break;
+    // copy the entry, since the process could change it.
+    sqe = r->sq[r->sq_head % URING_ENTRIES];
+    r->sq_head++;
+
+    cqe = &r->cq[r->cq_tail % URING_ENTRIES];
+    cqe->data = sqe.data;
+    cqe->res = uringop(&sqe);
+    // publish the completion before the new tail.
+    __sync_synchronize();
+    r->cq_tail++;
+  }
+  return done;
+}
@@ -0,0 +1,42 @@
+// Submission and completion rings, shared by a process and
+// the kernel in one page mapped at URING (see uring.c).
+//
+// The process fills sq[sq_tail % URING_ENTRIES] and then
+// advances sq_tail; uring_enter() consumes entries from
+// sq_head. The kernel posts a completion for each at
+// cq[cq_tail % URING_ENTRIES] and advances cq_tail; the
+// process consumes completions from cq_head.
+
+#define URING_ENTRIES 64
+
+// Operations
+#define URING_NOP   0
+#define URING_READ  1  // read(fd, addr, len), or pread() at off
+#define URING_WRITE 2  // write(fd, addr, len), or pwrite() at off
+#define URING_OPEN  3  // open(addr, len)
+#define URING_CLOSE 4  // close(fd)
+#define URING_FSYNC 5  // wait for fd's writes to reach the disk
+
+struct uring_sqe {
+  int op;         // URING_*
+  int fd;
+  uint64 addr;    // buffer, or path for URING_OPEN
+  int len;        // length, or mode for URING_OPEN
+  int off;        // file offset, or -1 for fd's own
+  uint64 data;    // copied to the completion
+};
+
+struct uring_cqe {
+  uint64 data;    // from the submission
+  int res;        // what the system call would have returned
+  int pad;
+};
+
+struct uring {
+  uint sq_head;
+  uint sq_tail;
+  uint cq_head;
+  uint cq_tail;
+  struct uring_sqe sq[URING_ENTRIES];
+  struct uring_cqe cq[URING_ENTRIES];
+};
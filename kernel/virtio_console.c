@@ -0,0 +1,263 @@
+//
+// driver for qemu's virtio console device, which stands in
+// for the uart as the console, for the read()s and write()s
+// of devsw[CONSOLE], if qemu has one. kernel printf()s still
+// go to the uart, since they must not wait.
+// uses qemu's mmio interface to virtio, like virtio_disk.c.
+//
+// qemu ... -device virtio-serial-device,bus=virtio-mmio-bus.2 -device virtconsole,chardev=c0
+//
+// the device has a receive queue, which we keep full of
+// buffers for it to put input in, and a transmit queue.
+// output collects in a ring, like the uart's, which is
+// handed to the device a contiguous run at a time rather
+// than a character at a time, which is what makes this
+// console fast.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "virtio.h"
+
+#define VCONS 2 // the console's virtio mmio interface
+
+// the address of virtio mmio register r.
+#define R(r) ((volatile uint32 *)(VIRTION(VCONS) + (r)))
+
+#define RXBUF 64      // bytes in each receive buffer
+#define TXBUF PGSIZE  // bytes in the transmit ring
+
+// one virtqueue, laid out as in virtio_disk.c.
+struct virtq {
+  char pages[2*PGSIZE];
+  struct VRingDesc *desc;
+  uint16 *avail;
+  struct UsedArea *used;
+  uint16 used_idx; // we've looked this far in used[2..NUM].
+};
+
+static struct {
+  struct virtq rx __attribute__ ((aligned (PGSIZE))); // queue 0
+  struct virtq tx __attribute__ ((aligned (PGSIZE))); // queue 1
+
+  // rx.desc[i] is always given to the device, for rxbuf[i].
+  char rxbuf[NUM][RXBUF];
+
+  // output waiting to be sent. tx.desc[0] covers the
+  // txn bytes from txr on while the device has them.
+  char txbuf[TXBUF];
+  uint txw;   // bytes added
+  uint txr;   // bytes sent
+  uint txn;   // bytes the device has; 0 if none
+  int nsleep; // writers asleep on txr, waiting for room
+
+  // initialized?
+  int init;
+
+  struct spinlock lock;
+} __attribute__ ((aligned (PGSIZE))) vcons;
+
+// set up queue n at q.
+static void
+vq_init(struct virtq *q, int n)
+{
+  *R(VIRTIO_MMIO_QUEUE_SEL) = n;
+  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtio console has no queue");
+  if(max < NUM)
+    panic("virtio console max queue too short");
+  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  memset(q->pages, 0, sizeof(q->pages));
+  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)q->pages) >> PGSHIFT;
+
+  q->desc = (struct VRingDesc *) q->pages;
+  q->avail = (uint16*)(((char*)q->desc) + NUM*sizeof(struct VRingDesc));
+  q->used = (struct UsedArea *) (q->pages + PGSIZE);
+  q->used_idx = 0;
+}
+
+// give descriptor i on queue n (at q) to the device.
+static void
+vq_post(struct virtq *q, int n, int i)
+{
+  q->avail[2 + (q->avail[1] % NUM)] = i;
+  __sync_synchronize();
+  q->avail[1] = q->avail[1] + 1;
+
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = n; // value is queue number
+}
+
+void
+virtio_cons_init(void)
+{
+  uint32 status = 0;
+
+  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(VIRTIO_MMIO_VERSION) != 1 ||
+     *R(VIRTIO_MMIO_DEVICE_ID) != 3 ||
+     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    // no console; stay with the uart.
+    return;
+  }
+
+  printf("virtio console init\n");
+
+  initlock(&vcons.lock, "virtio_cons");
+
+  status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  status |= VIRTIO_CONFIG_S_DRIVER;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // negotiate features: none, so there is just
+  // the one port, on queues 0 and 1.
+  *R(VIRTIO_MMIO_DRIVER_FEATURES) = 0;
+
+  // tell device that feature negotiation is complete.
+  status |= VIRTIO_CONFIG_S_FEATURES_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // tell device we're completely ready.
+  status |= VIRTIO_CONFIG_S_DRIVER_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+
+  vq_init(&vcons.rx, 0);
+  vq_init(&vcons.tx, 1);
+
+  // give the device every receive buffer.
+  for(int i = 0; i < NUM; i++){
+    vcons.rx.desc[i].addr = (uint64) vcons.rxbuf[i];
+    vcons.rx.desc[i].len = RXBUF;
+    vcons.rx.desc[i].flags = VRING_DESC_F_WRITE; // device writes rxbuf
+    vcons.rx.desc[i].next = 0;
+    vq_post(&vcons.rx, 0, i);
+  }
+
+  vcons.txw = vcons.txr = vcons.txn = 0;
+  vcons.init = 1;
+  // plic.c and trap.c arrange for interrupts from VIRTIO2_IRQ.
+}
+
+// if the device isn't busy sending and there is output
+// waiting, give it the next contiguous run of the ring.
+// caller holds vcons.lock.
+static void
+vcons_start(void)
+{
+  uint n;
+
+  if(vcons.txn > 0 || vcons.txr == vcons.txw)
+    return;
+  n = vcons.txw - vcons.txr;
+  if(n > TXBUF - vcons.txr % TXBUF)
+    n = TXBUF - vcons.txr % TXBUF;
+  vcons.tx.desc[0].addr = (uint64) &vcons.txbuf[vcons.txr % TXBUF];
+  vcons.tx.desc[0].len = n;
+  vcons.tx.desc[0].flags = 0; // device reads txbuf
+  vcons.tx.desc[0].next = 0;
+  vcons.txn = n;
+  vq_post(&vcons.tx, 1, 0);
+}
+
+// add the n characters at buf to the output ring, waiting
+// while it is full, like uartwrite(). returns -1 if there
+// is no virtio console.
+int
+virtio_cons_write(char *buf, int n)
+{
+  int i, m;
+
+  if(!vcons.init)
+    return -1;
+
+  acquire(&vcons.lock);
+  for(i = 0; i < n; i += m){
+    while(vcons.txw == vcons.txr + TXBUF){
+      vcons_start();
+      vcons.nsleep++;
+      sleep(&vcons.txr, &vcons.lock);
+      vcons.nsleep--;
+    }
+    m = n - i;
+    if(m > TXBUF - (vcons.txw - vcons.txr))
+      m = TXBUF - (vcons.txw - vcons.txr);
+    if(m > TXBUF - vcons.txw % TXBUF)
+      m = TXBUF - vcons.txw % TXBUF;
+    memmove(&vcons.txbuf[vcons.txw % TXBUF], buf + i, m);
+    vcons.txw += m;
+  }
+  vcons_start();
+  release(&vcons.lock);
+  return 0;
+}
+
+// add c to the output ring without waiting, for echoing
+// input from interrupts; drops c if the ring is full.
+// returns -1 if there is no virtio console.
+int
+virtio_cons_putc(int c)
+{
+  if(!vcons.init)
+    return -1;
+
+  acquire(&vcons.lock);
+  if(vcons.txw != vcons.txr + TXBUF)
+    vcons.txbuf[vcons.txw++ % TXBUF] = c;
+  vcons_start();
+  release(&vcons.lock);
+  return 0;
+}
+
+void
+virtio_cons_intr(void)
+{
+  char in[RXBUF];
+  int id, len;
+
+  if(!vcons.init)
+    return;
+
+  acquire(&vcons.lock);
+
+  // the device won't interrupt again until we tell
+  // it we've seen this interrupt.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  // output the device has sent.
+  while((vcons.tx.used_idx % NUM) != (vcons.tx.used->id % NUM)){
+    vcons.txr += vcons.txn;
+    vcons.txn = 0;
+    vcons.tx.used_idx = (vcons.tx.used_idx + 1) % NUM;
+  }
+  if(vcons.nsleep > 0)
+    wakeup(&vcons.txr);
+  vcons_start();
+
+  // input, a buffer at a time. consoleintr() takes
+  // cons.lock and may echo with virtio_cons_putc(),
+  // so it's called without vcons.lock.
+  while((vcons.rx.used_idx % NUM) != (vcons.rx.used->id % NUM)){
+    id = vcons.rx.used->elems[vcons.rx.used_idx].id;
+    len = vcons.rx.used->elems[vcons.rx.used_idx].len;
+    if(len > RXBUF)
+      len = RXBUF;
+    memmove(in, vcons.rxbuf[id], len);
+    vcons.rx.used_idx = (vcons.rx.used_idx + 1) % NUM;
+    vq_post(&vcons.rx, 0, id);
+
+    release(&vcons.lock);
+    for(int i = 0; i < len; i++)
+      consoleintr(in[i]);
+    acquire(&vcons.lock);
+  }
+
+  release(&vcons.lock);
+}
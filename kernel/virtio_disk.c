@@ -46,6 +46,10 @@ struct disk {
   // initialized?
   int init;
 
+  // most blocks one discard request may cover,
+  // or 0 if the device can't discard.
+  uint32 max_discard;
+
   struct spinlock vdisk_lock;
 } __attribute__ ((aligned (PGSIZE))) disk[NDISK];
   
@@ -92,6 +96,12 @@ virtio_disk_init(int n)
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
   *R(n, VIRTIO_MMIO_STATUS) = status;
 
+  // bfree() asks us to discard freed blocks if we
+  // kept the discard feature.
+  disk[n].max_discard = 0;
+  if(features & (1 << VIRTIO_BLK_F_DISCARD))
+    disk[n].max_discard = *R(n, VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_MAX_DISCARD_SECTORS) / (BSIZE / 512);
+
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
   *R(n, VIRTIO_MMIO_STATUS) = status;
@@ -200,11 +210,7 @@ virtio_disk_rw(int n, struct buf *b, int write)
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr buf0;
 
   if(write)
     buf0.type = VIRTIO_BLK_T_OUT; // write the disk
@@ -260,6 +266,84 @@ virtio_disk_rw(int n, struct buf *b, int write)
   release(&disk[n].vdisk_lock);
 }
 
+// Tell the disk that blocks [blockno, blockno+nblocks)
+// no longer hold data, so the host can release the storage
+// behind them. Does nothing if the disk can't discard.
+// Discard is only a hint, so errors are ignored.
+void
+virtio_disk_discard(int n, uint blockno, uint nblocks)
+{
+  struct virtio_blk_outhdr buf0;
+  struct virtio_blk_discard seg;
+  int idx[3];
+  uint m;
+
+  if(disk[n].max_discard == 0)
+    return;
+
+  acquire(&disk[n].vdisk_lock);
+
+  while(nblocks > 0){
+    m = nblocks;
+    if(m > disk[n].max_discard)
+      m = disk[n].max_discard;
+
+    while(1){
+      if(alloc3_desc(n, idx) == 0) {
+        break;
+      }
+      sleep(&disk[n].free[0], &disk[n].vdisk_lock);
+    }
+
+    buf0.type = VIRTIO_BLK_T_DISCARD;
+    buf0.reserved = 0;
+    buf0.sector = 0;
+
+    seg.sector = blockno * (BSIZE / 512);
+    seg.num_sectors = m * (BSIZE / 512);
+    seg.flags = 0;
+
+    // buf0 and seg are on a kernel stack, which is not
+    // direct mapped, thus the calls to kvmpa().
+    disk[n].desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
+    disk[n].desc[idx[0]].len = sizeof(buf0);
+    disk[n].desc[idx[0]].flags = VRING_DESC_F_NEXT;
+    disk[n].desc[idx[0]].next = idx[1];
+
+    disk[n].desc[idx[1]].addr = (uint64) kvmpa((uint64) &seg);
+    disk[n].desc[idx[1]].len = sizeof(seg);
+    disk[n].desc[idx[1]].flags = VRING_DESC_F_NEXT; // device reads seg
+    disk[n].desc[idx[1]].next = idx[2];
+
+    // no struct buf to wake up; virtio_disk_intr() wakes
+    // the info[] slot instead, and the device overwrites
+    // the 0xff status when it is done.
+    disk[n].info[idx[0]].b = 0;
+    disk[n].info[idx[0]].status = 0xff;
+    disk[n].desc[idx[2]].addr = (uint64) &disk[n].info[idx[0]].status;
+    disk[n].desc[idx[2]].len = 1;
+    disk[n].desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
+    disk[n].desc[idx[2]].next = 0;
+
+    disk[n].avail[2 + (disk[n].avail[1] % NUM)] = idx[0];
+    __sync_synchronize();
+    disk[n].avail[1] = disk[n].avail[1] + 1;
+
+    *R(n, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+
+    while((uchar)disk[n].info[idx[0]].status == 0xff) {
+      sleep(&disk[n].info[idx[0]], &disk[n].vdisk_lock);
+    }
+
+    free_chain(n, idx[0]);
+
+    blockno += m;
+    nblocks -= m;
+  }
+
+  release(&disk[n].vdisk_lock);
+}
+
 void
 virtio_disk_intr(int n)
 {
@@ -268,6 +352,13 @@ virtio_disk_intr(int n)
   while((disk[n].used_idx % NUM) != (disk[n].used->id % NUM)){
     int id = disk[n].used->elems[disk[n].used_idx].id;
 
+    if(disk[n].info[id].b == 0){
+      // a discard; virtio_disk_discard() checks the status.
+      wakeup(&disk[n].info[id]);
+      disk[n].used_idx = (disk[n].used_idx + 1) % NUM;
+      continue;
+    }
+
     if(disk[n].info[id].status != 0)
       panic("virtio_disk_intr status");
     
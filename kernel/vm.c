@@ -37,6 +37,9 @@ kvminit()
   // virtio mmio disk interface 1
   kvmmap(VIRTION(1), VIRTION(1), PGSIZE, PTE_R | PTE_W);
 
+  // virtio mmio console interface
+  kvmmap(VIRTION(2), VIRTION(2), PGSIZE, PTE_R | PTE_W);
+
   // CLINT
   kvmmap(CLINT, CLINT, 0x10000, PTE_R | PTE_W);
 
@@ -331,6 +334,8 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_COW)
+      flags = (flags | PTE_W) & ~PTE_COW;
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -359,6 +364,91 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Pages mapped copy-on-write (PTE_COW) share their physical
+// page with a pipe, or with another process it was moved to
+// through one (see pipewritev() and pipereadv()). They are
+// mapped read-only until written.
+
+// If user page va is copy-on-write, give it a page of its
+// own, or if no one else still has its page, just make it
+// writable. Return 1 if it was copy-on-write, 0 if it
+// wasn't, -1 if va is not mapped or there's no memory.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+    return -1;
+  if((*pte & PTE_COW) == 0)
+    return 0;
+  pa = PTE2PA(*pte);
+  if(krefcnt((void*)pa) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | PTE_FLAGS(*pte);
+    kfree((void*)pa);
+  }
+  *pte = (*pte | PTE_W) & ~PTE_COW;
+  return 1;
+}
+
+// Share user page va, which must be readable, by making
+// it copy-on-write, and return its physical page with a
+// reference added for the caller; 0 if it can't be shared.
+uint64
+uvmshare(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+
+  if(va >= MAXVA)
+    return 0;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_R)) != (PTE_V|PTE_U|PTE_R))
+    return 0;
+  if(*pte & PTE_W)
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+  pa = PTE2PA(*pte);
+  kref((void*)pa);
+  return pa;
+}
+
+// Map physical page pa at user page va in place of the page
+// there, which must be writable or copy-on-write, taking
+// over the caller's reference to pa; return the old page,
+// whose reference passes to the caller, or 0 if va can't
+// be replaced. pa is mapped copy-on-write if others still
+// have it.
+uint64
+uvmswap(pagetable_t pagetable, uint64 va, uint64 pa)
+{
+  pte_t *pte;
+  uint64 old;
+  int flags;
+
+  if(va >= MAXVA)
+    return 0;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) ||
+     (*pte & (PTE_W|PTE_COW)) == 0)
+    return 0;
+  old = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte) & ~(PTE_W|PTE_COW);
+  if(krefcnt((void*)pa) > 1)
+    flags |= PTE_COW;
+  else
+    flags |= PTE_W;
+  *pte = PA2PTE(pa) | flags;
+  return old;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -369,6 +459,8 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
+    if(uvmcow(pagetable, va0) < 0)
+      return -1;
     pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
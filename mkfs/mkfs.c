@@ -18,12 +18,14 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map |
+//                                 block reference counts | data blocks ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
+int nrefblocks = FSSIZE/RPB + 1;
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
-int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
+int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap, refs)
 int nblocks;  // Number of data blocks
 
 int fsfd;
@@ -91,7 +93,7 @@ main(int argc, char *argv[])
   }
 
   // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
+  nmeta = 2 + nlog + ninodeblocks + nbitmap + nrefblocks;
   nblocks = FSSIZE - nmeta;
 
   sb.magic = FSMAGIC;
@@ -102,9 +104,10 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.refstart = xint(2+nlog+ninodeblocks+nbitmap);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u, refcount blocks %u) blocks %d total %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nrefblocks, nblocks, FSSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -172,6 +175,13 @@ main(int argc, char *argv[])
 
   balloc(freeblock);
 
+  // record the free block and inode counts.
+  sb.nfree = xint(FSSIZE - freeblock);
+  sb.nifree = xint(NINODES - freeinode);
+  memset(buf, 0, sizeof(buf));
+  memmove(buf, &sb, sizeof(sb));
+  wsect(1, buf);
+
   exit(0);
 }
 
@@ -0,0 +1,52 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int fd0, fd1, n;
+  struct stat st;
+
+  if(argc != 3){
+    fprintf(2, "Usage: cp from to\n");
+    exit(1);
+  }
+
+  if((fd0 = open(argv[1], O_RDONLY)) < 0){
+    fprintf(2, "cp: cannot open %s\n", argv[1]);
+    exit(1);
+  }
+  if(fstat(fd0, &st) < 0 || st.type != T_FILE){
+    fprintf(2, "cp: %s is not a file\n", argv[1]);
+    exit(1);
+  }
+
+  // there is no O_TRUNC, so remove an old copy first
+  // to keep any of its bytes past the end of the new one.
+  if(stat(argv[2], &st) >= 0){
+    if(st.type != T_FILE){
+      fprintf(2, "cp: %s is not a file\n", argv[2]);
+      exit(1);
+    }
+    unlink(argv[2]);
+  }
+  if((fd1 = open(argv[2], O_CREATE | O_WRONLY)) < 0){
+    fprintf(2, "cp: cannot create %s\n", argv[2]);
+    exit(1);
+  }
+
+  // the kernel copies, sharing whole blocks between
+  // the two files where it can.
+  while((n = copy_file_range(fd0, fd1, 1 << 30)) > 0)
+    ;
+  if(n < 0){
+    fprintf(2, "cp: copy to %s failed\n", argv[2]);
+    exit(1);
+  }
+
+  close(fd0);
+  close(fd1);
+  exit(0);
+}
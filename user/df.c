@@ -0,0 +1,20 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct statfs st;
+
+  if(statfs(&st) < 0){
+    fprintf(2, "df: statfs failed\n");
+    exit(1);
+  }
+
+  printf("blocks %d free %d used %d (block size %d)\n",
+         st.blocks, st.bfree, st.blocks - st.bfree, st.bsize);
+  printf("inodes %d free %d used %d\n",
+         st.files, st.ffree, st.files - st.ffree);
+  exit(0);
+}
@@ -12,6 +12,7 @@
 #define BACK  5
 
 #define MAXARGS 10
+#define PIPEBUF (64*1024)  // pipeline buffer size
 
 struct cmd {
   int type;
@@ -101,6 +102,9 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
+    // a big buffer saves switching between the two sides;
+    // if there's no memory for it, the default will do.
+    fcntl(p[1], F_SETPIPE_SZ, PIPEBUF);
     if(fork1() == 0){
       close(1);
       dup(p[1]);
@@ -0,0 +1,155 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/poll.h"
+#include "kernel/syscall.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+// Run a command with all of its system calls traced.
+// The calls are printed, on fd 2, as strace drains the
+// command's trace session about once a clock tick; after
+// the command exits comes the latency histogram of each
+// kind of call it and its children made. Times are in
+// time CSR cycles.
+
+char *names[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_ntas]    "ntas",
+[SYS_readdirplus] "readdirplus",
+[SYS_statfs]  "statfs",
+[SYS_copy_file_range] "copy_file_range",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_poll]    "poll",
+[SYS_pipe2]   "pipe2",
+[SYS_fcntl]   "fcntl",
+[SYS_uring_setup] "uring_setup",
+[SYS_uring_enter] "uring_enter",
+[SYS_syscall_batch] "syscall_batch",
+[SYS_trace]   "trace",
+[SYS_tracebuf] "tracebuf",
+[SYS_tracehist] "tracehist",
+[SYS_sysinfo] "sysinfo",
+[SYS_splice]  "splice",
+[SYS_tee]     "tee",
+[SYS_vmsplice] "vmsplice",
+[SYS_mq_open] "mq_open",
+[SYS_mq_send] "mq_send",
+[SYS_mq_receive] "mq_receive",
+[SYS_mq_unlink] "mq_unlink",
+[SYS_mq_getattr] "mq_getattr",
+[SYS_socket] "socket",
+[SYS_socketpair] "socketpair",
+[SYS_bind] "bind",
+[SYS_listen] "listen",
+[SYS_accept] "accept",
+[SYS_connect] "connect",
+};
+
+#define NNAMES (sizeof(names)/sizeof(names[0]))
+
+struct traceent ents[64];
+char seen[NTRACESYS];
+
+char*
+name(int num)
+{
+  if(num < NNAMES && names[num])
+    return names[num];
+  return "?";
+}
+
+// Print what the kernel has recorded so far in the
+// session started by process pid.
+// Returns the number of calls printed.
+int
+drain(int pid)
+{
+  int i, n, tot;
+
+  tot = 0;
+  while((n = tracebuf(pid, ents, sizeof(ents)/sizeof(ents[0]))) > 0){
+    for(i = 0; i < n; i++){
+      fprintf(2, "%d: %s -> %d [%d]\n", ents[i].pid, name(ents[i].num),
+              (int)ents[i].ret, (int)(ents[i].end - ents[i].start));
+      seen[ents[i].num] = 1;
+    }
+    tot += n;
+  }
+  return tot;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2], pid, num, b;
+  struct pollfd pfd;
+  uint64 hist[NHIST];
+
+  if(argc < 2){
+    fprintf(2, "Usage: strace command [args...]\n");
+    exit(1);
+  }
+
+  // only the command holds the pipe's write end,
+  // so the pipe reports POLLHUP once it has exited.
+  if(pipe(fds) < 0){
+    fprintf(2, "strace: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "strace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    trace(~0UL);
+    exec(argv[1], argv+1);
+    fprintf(2, "strace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  close(fds[1]);
+
+  pfd.fd = fds[0];
+  pfd.events = POLLIN;
+  while(poll(&pfd, 1, 1) == 0)
+    drain(pid);
+  wait(0);
+  drain(pid);
+
+  for(num = 0; num < NTRACESYS; num++){
+    if(!seen[num] || tracehist(pid, num, hist) < 0)
+      continue;
+    fprintf(2, "%s:", name(num));
+    for(b = 0; b < NHIST; b++){
+      if(hist[b])
+        fprintf(2, " %s%d:%d", b == NHIST-1 ? ">=" : "<",
+                b == NHIST-1 ? 1 << b : 1 << (b+1), (int)hist[b]);
+    }
+    fprintf(2, "\n");
+  }
+  exit(0);
+}
@@ -0,0 +1,34 @@
+#include "kernel/types.h"
+#include "kernel/sysinfo.h"
+#include "user/user.h"
+
+// Show free memory, process slots, cache use and the
+// log once a second (ten clock ticks); with an argument,
+// only that many times.
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si;
+  int n;
+
+  n = argc > 1 ? atoi(argv[1]) : -1;
+  while(n != 0){
+    if(sysinfo(&si) < 0){
+      fprintf(2, "top: sysinfo failed\n");
+      exit(1);
+    }
+    printf("\x1b[H\x1b[2J");
+    printf("uptime %d ticks\n", uptime());
+    printf("mem    %d KB free (%d pages)\n", si.freepages * 4, si.freepages);
+    printf("procs  %d/%d used, %d runnable\n", si.procused, si.nproc, si.procrun);
+    printf("bcache %d/%d in use, %d valid\n", si.bufused, si.nbuf, si.bufvalid);
+    printf("icache %d/%d in use\n", si.inodeused, si.ninode);
+    printf("log    %d/%d blocks, %d ops\n", si.logused, si.logsize, si.logops);
+    if(n > 0)
+      n--;
+    if(n != 0)
+      sleep(10);
+  }
+  exit(0);
+}
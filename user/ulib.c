@@ -1,6 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +136,26 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Like getpid() and uptime(), but read from the kernel's
+// USYSCALL page instead of trapping into the kernel.
+int
+ugetpid(void)
+{
+  return ((struct usyscall*)USYSCALL)->pid;
+}
+
+int
+uuptime(void)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+
+  return (r_time() - u->timebase) / u->interval;
+}
+
+// The CPU this process was last scheduled on.
+int
+ucpu(void)
+{
+  return ((struct usyscall*)USYSCALL)->cpu;
+}
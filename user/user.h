@@ -1,5 +1,14 @@
 struct stat;
 struct rtcdate;
+struct direntplus;
+struct iovec;
+struct pollfd;
+struct uring;
+struct sysop;
+struct traceent;
+struct statfs;
+struct sysinfo;
+struct mq_attr;
 
 // system calls
 int fork(void);
@@ -27,6 +36,37 @@ int ntas();
 int crash(const char*, int);
 int mount(char*, char *);
 int umount(char*);
+int readdirplus(int, struct direntplus*, int);
+int statfs(struct statfs*);
+int copy_file_range(int, int, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int poll(struct pollfd*, int, int);
+int pipe2(int*, int);
+int fcntl(int, int, int);
+struct uring* uring_setup(void);
+int uring_enter(int);
+int syscall_batch(struct sysop*, int, int);
+int trace(uint64);
+int tracebuf(int, struct traceent*, int);
+int tracehist(int, int, uint64*);
+int sysinfo(struct sysinfo*);
+int splice(int, int, int);
+int tee(int, int, int);
+int vmsplice(int, struct iovec*, int);
+int mq_open(const char*, int, struct mq_attr*);
+int mq_send(int, const void*, int, int);
+int mq_receive(int, void*, int, int*);
+int mq_unlink(const char*);
+int mq_getattr(int, struct mq_attr*);
+int socket(void);
+int socketpair(int*);
+int bind(int, const char*);
+int listen(int, int);
+int accept(int);
+int connect(int, const char*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -42,5 +82,8 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int ugetpid(void);
+int uuptime(void);
+int ucpu(void);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
@@ -4,6 +4,13 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "kernel/poll.h"
+#include "kernel/uring.h"
+#include "kernel/sysbatch.h"
+#include "kernel/sysinfo.h"
+#include "kernel/trace.h"
+#include "kernel/mqueue.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -253,6 +260,270 @@ createtest(char *s)
   }
 }
 
+// copy_file_range() shares the copy's blocks with the
+// original, writing to either copy gives it its own block
+// again, and removing both frees every block.
+void
+copyfiletest(char *s)
+{
+  enum { NB=20 }; // more than NDIRECT, so both use an indirect block
+  struct statfs st0, st1, st2;
+  int fd0, fd1, i, k;
+  char c0, c1;
+
+  unlink("copyfile0");
+  unlink("copyfile1");
+  if(statfs(&st0) < 0){
+    printf("%s: statfs failed\n", s);
+    exit(1);
+  }
+  fd0 = open("copyfile0", O_CREATE|O_RDWR);
+  if(fd0 < 0){
+    printf("%s: create copyfile0 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NB; i++){
+    memset(buf, 'a' + i, BSIZE);
+    if(write(fd0, buf, BSIZE) != BSIZE){
+      printf("%s: write copyfile0 failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd0);
+
+  fd0 = open("copyfile0", O_RDWR);
+  fd1 = open("copyfile1", O_CREATE|O_RDWR);
+  if(fd0 < 0 || fd1 < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  statfs(&st1);
+  if(copy_file_range(fd0, fd1, NB*BSIZE) != NB*BSIZE){
+    printf("%s: copy_file_range failed\n", s);
+    exit(1);
+  }
+  statfs(&st2);
+  // only copyfile1's indirect block is new.
+  if(st1.bfree - st2.bfree != 1){
+    printf("%s: copy used %d blocks\n", s, st1.bfree - st2.bfree);
+    exit(1);
+  }
+
+  // a whole block in one copy, part of a block in the other.
+  memset(buf, 'X', BSIZE);
+  if(pwrite(fd1, buf, BSIZE, 3*BSIZE) != BSIZE ||
+     pwrite(fd0, "Y", 1, 7*BSIZE + 10) != 1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NB; i++){
+    if(pread(fd0, buf, BSIZE, i*BSIZE) != BSIZE ||
+       pread(fd1, buf + BSIZE, BSIZE, i*BSIZE) != BSIZE){
+      printf("%s: pread failed\n", s);
+      exit(1);
+    }
+    for(k = 0; k < BSIZE; k++){
+      c0 = i == 7 && k == 10 ? 'Y' : 'a' + i;
+      c1 = i == 3 ? 'X' : 'a' + i;
+      if(buf[k] != c0 || buf[BSIZE + k] != c1){
+        printf("%s: block %d byte %d wrong\n", s, i, k);
+        exit(1);
+      }
+    }
+  }
+  close(fd0);
+  close(fd1);
+
+  unlink("copyfile0");
+  unlink("copyfile1");
+  statfs(&st1);
+  if(st1.bfree != st0.bfree || st1.ffree != st0.ffree){
+    printf("%s: %d blocks, %d inodes not freed\n", s,
+           st0.bfree - st1.bfree, st0.ffree - st1.ffree);
+    exit(1);
+  }
+}
+
+// pread() and pwrite() should use the offset they are
+// given, and leave the descriptor's own where it was.
+void
+prwtest(char *s)
+{
+  char b[16];
+  int fd, p[2];
+
+  unlink("prwfile");
+  fd = open("prwfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "hello world", 11) != 11){
+    printf("%s: create prwfile failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "HE", 2, 0) != 2 || pwrite(fd, "?", 1, -1) != -1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 5, 6) != 5 || memcmp(b, "world", 5) != 0 ||
+     pread(fd, b, sizeof(b), 11) != 0){
+    printf("%s: pread failed\n", s);
+    exit(1);
+  }
+  // the offset is still 11, at the end of the file.
+  if(read(fd, b, sizeof(b)) != 0 || write(fd, "!", 1) != 1){
+    printf("%s: offset moved\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("prwfile", O_RDONLY);
+  if(fd < 0 || read(fd, b, sizeof(b)) != 12 || memcmp(b, "HEllo world!", 12) != 0){
+    printf("%s: prwfile has the wrong contents\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "x", 1, 0) != -1){
+    printf("%s: pwrite to a read-only fd succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pwrite(p[1], "x", 1, 0) != -1 || pread(p[0], b, 1, 0) != -1){
+    printf("%s: pread or pwrite on a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  close(p[1]);
+  unlink("prwfile");
+}
+
+// statfs()'s free counts should follow creating, writing
+// and unlinking a file.
+void
+statfstest(char *s)
+{
+  enum { NB=5 }; // direct blocks only, so no indirect block
+  struct statfs st0, st1;
+  int fd, i;
+
+  if(mkdir("statfsdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  // the directory's one block has room for the new entry.
+  if(statfs(&st0) < 0 || st0.bsize != BSIZE ||
+     st0.bfree > st0.blocks || st0.ffree > st0.files){
+    printf("%s: bad statfs\n", s);
+    exit(1);
+  }
+  fd = open("statfsdir/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  statfs(&st1);
+  if(st1.ffree != st0.ffree - 1 || st1.bfree != st0.bfree){
+    printf("%s: create took %d inodes, %d blocks\n", s,
+           st0.ffree - st1.ffree, st0.bfree - st1.bfree);
+    exit(1);
+  }
+  for(i = 0; i < NB; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  statfs(&st1);
+  if(st1.bfree != st0.bfree - NB){
+    printf("%s: writing %d blocks took %d\n", s, NB, st0.bfree - st1.bfree);
+    exit(1);
+  }
+  if(unlink("statfsdir/f") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+  statfs(&st1);
+  if(st1.bfree != st0.bfree || st1.ffree != st0.ffree){
+    printf("%s: %d blocks, %d inodes not freed\n", s,
+           st0.bfree - st1.bfree, st0.ffree - st1.ffree);
+    exit(1);
+  }
+  unlink("statfsdir");
+}
+
+// readdirplus() should return each entry of a directory,
+// over several calls, with the inode number, type, link
+// count and size that stat() reports for it.
+void
+readdirplustest(char *s)
+{
+  struct direntplus de[4];
+  struct stat st;
+  char path[7+DIRSIZ+1];
+  int fd, i, n, seen;
+
+  if(mkdir("rdpdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  fd = open("rdpdir/a", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, 100) != 100){
+    printf("%s: create rdpdir/a failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("rdpdir/b", O_CREATE|O_RDWR);
+  if(fd < 0 || mkdir("rdpdir/c") < 0 || link("rdpdir/a", "rdpdir/d") < 0){
+    printf("%s: create rdpdir entries failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("rdpdir", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open rdpdir failed\n", s);
+    exit(1);
+  }
+  seen = 0;
+  strcpy(path, "rdpdir/");
+  while((n = readdirplus(fd, de, sizeof(de))) > 0){
+    for(i = 0; i < n / sizeof(de[0]); i++){
+      memmove(path+7, de[i].name, DIRSIZ);
+      path[7+DIRSIZ] = 0;
+      if(stat(path, &st) < 0 || st.ino != de[i].inum || st.type != de[i].type ||
+         st.nlink != de[i].nlink || st.size != de[i].size){
+        printf("%s: %s doesn't match stat()\n", s, path);
+        exit(1);
+      }
+      if(strcmp(path, "rdpdir/a") == 0 && (de[i].nlink != 2 || de[i].size != 100)){
+        printf("%s: wrong links or size for rdpdir/a\n", s);
+        exit(1);
+      }
+      seen++;
+    }
+  }
+  close(fd);
+  if(n != 0 || seen != 6){
+    printf("%s: read %d entries, then %d\n", s, seen, n);
+    exit(1);
+  }
+
+  fd = open("rdpdir/a", O_RDONLY);
+  if(fd < 0 || readdirplus(fd, de, sizeof(de)) != -1){
+    printf("%s: readdirplus of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(unlink("rdpdir/a") < 0 || unlink("rdpdir/b") < 0 || unlink("rdpdir/c") < 0 ||
+     unlink("rdpdir/d") < 0 || unlink("rdpdir") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+}
+
 void dirtest(char *s)
 {
   printf("mkdir test\n");
@@ -334,6 +605,1023 @@ exectest(char *s)
 
 }
 
+// writev and readv of a header and a payload,
+// through a file and through a pipe.
+void
+iovtest(char *s)
+{
+  int fd, fds[2], i;
+  char hdr[8], rhdr[8];
+  struct iovec iov[2];
+  enum { SZ=3000 };
+
+  for(i = 0; i < sizeof(hdr); i++)
+    hdr[i] = 'h' + i;
+  for(i = 0; i < SZ; i++)
+    buf[i] = i;
+
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create iovfile failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = SZ;
+  if(writev(fd, iov, 2) != sizeof(hdr) + SZ){
+    printf("%s: writev to file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("iovfile", O_RDONLY);
+  memset(buf, 0, SZ);
+  iov[0].iov_base = rhdr;
+  if(readv(fd, iov, 2) != sizeof(hdr) + SZ){
+    printf("%s: readv from file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("iovfile");
+  if(memcmp(hdr, rhdr, sizeof(hdr)) != 0){
+    printf("%s: wrong header from file\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if(buf[i] != (char)i){
+      printf("%s: wrong payload from file\n", s);
+      exit(1);
+    }
+  }
+
+  // small enough to fit in the pipe, so that one readv
+  // gets all of it.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = hdr;
+  iov[1].iov_len = 100;
+  if(writev(fds[1], iov, 2) != sizeof(hdr) + 100){
+    printf("%s: writev to pipe failed\n", s);
+    exit(1);
+  }
+  memset(rhdr, 0, sizeof(rhdr));
+  memset(buf, 0, 100);
+  iov[0].iov_base = rhdr;
+  if(readv(fds[0], iov, 2) != sizeof(hdr) + 100){
+    printf("%s: readv from pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(memcmp(hdr, rhdr, sizeof(hdr)) != 0 || buf[99] != 99){
+    printf("%s: wrong data from pipe\n", s);
+    exit(1);
+  }
+}
+
+// poll two pipes, only one of which a child writes to.
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, xstatus;
+  struct pollfd fds[2];
+  char c;
+
+  if(pipe(a) != 0 || pipe(b) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fds[0].fd = a[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = b[0];
+  fds[1].events = POLLIN;
+  if(poll(fds, 2, 0) != 0){
+    printf("%s: poll of empty pipes returned ready\n", s);
+    exit(1);
+  }
+  if(poll(fds, 2, 2) != 0){
+    printf("%s: poll did not time out\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(fds, 2, -1) != 1 || fds[0].revents != 0 || fds[1].revents != POLLIN){
+    printf("%s: wrong poll result\n", s);
+    exit(1);
+  }
+  if(read(b[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: read after poll failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  // closing the write end makes the read end ready.
+  close(a[1]);
+  if(poll(fds, 1, -1) != 1 || (fds[0].revents & POLLHUP) == 0){
+    printf("%s: no POLLHUP after close\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+  exit(xstatus);
+}
+
+// O_NONBLOCK pipes return -EAGAIN instead of waiting.
+void
+nonblocktest(char *s)
+{
+  int fds[2], n, tot;
+  char c;
+
+  if(pipe2(fds, O_NONBLOCK) != 0){
+    printf("%s: pipe2() failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], &c, 1) != -EAGAIN){
+    printf("%s: read of empty pipe did not fail with EAGAIN\n", s);
+    exit(1);
+  }
+  tot = 0;
+  while((n = write(fds[1], buf, sizeof(buf))) > 0)
+    tot += n;
+  if(n != -EAGAIN || tot == 0 || tot >= sizeof(buf)){
+    printf("%s: write to full pipe returned %d after %d\n", s, n, tot);
+    exit(1);
+  }
+  if((fcntl(fds[0], F_GETFL, 0) & O_NONBLOCK) == 0){
+    printf("%s: F_GETFL lost O_NONBLOCK\n", s);
+    exit(1);
+  }
+  // a blocking read now finds the data.
+  fcntl(fds[0], F_SETFL, 0);
+  if(read(fds[0], buf, tot) != tot){
+    printf("%s: read of full pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // nothing has been typed at the console.
+  fds[0] = open("console", O_RDONLY|O_NONBLOCK);
+  if(fds[0] < 0){
+    printf("%s: open console failed\n", s);
+    exit(1);
+  }
+  if((n = read(fds[0], &c, 1)) != -EAGAIN){
+    printf("%s: console read returned %d, not -EAGAIN\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// grow and shrink a pipe's buffer while it holds data.
+void
+pipesizetest(char *s)
+{
+  int fds[2], i, n, tot;
+  char rbuf[1000];
+
+  if(pipe2(fds, O_NONBLOCK) != 0){
+    printf("%s: pipe2() failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 4096){
+    printf("%s: default pipe size %d\n", s, fcntl(fds[0], F_GETPIPE_SZ, 0));
+    exit(1);
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i % 251;
+  if(write(fds[1], buf, 3000) != 3000){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  // grow the buffer with 1000 bytes in it at stream
+  // position 2000; filling it then wraps around its end.
+  if(read(fds[0], rbuf, 1000) != 1000 || read(fds[0], rbuf, 1000) != 1000 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 5000) != 8192){
+    printf("%s: F_SETPIPE_SZ failed\n", s);
+    exit(1);
+  }
+  tot = 3000;
+  while((n = write(fds[1], buf + tot, sizeof(buf) - tot)) > 0)
+    tot += n;
+  if(tot != 2000 + 8192){
+    printf("%s: pipe took %d bytes\n", s, tot);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1){
+    printf("%s: shrank a pipe below its contents\n", s);
+    exit(1);
+  }
+  for(i = 2000; i < tot; i += n){
+    n = read(fds[0], rbuf, sizeof(rbuf));
+    if(n <= 0 || memcmp(rbuf, buf + i, n) != 0){
+      printf("%s: bad data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != 4096 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 1024*1024) != -1){
+    printf("%s: F_SETPIPE_SZ limits wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// with a reader watermark of 100, a writer that keeps
+// writing less should wake neither poll() nor read(); but
+// once it has been idle for a tick, what it wrote should
+// get through, so that requests and replies of a byte work.
+void
+lowattest(char *s)
+{
+  int req[2], rep[2], i, pid, xstatus, n;
+  char c;
+  struct pollfd pfd;
+
+  if(pipe(req) < 0 || pipe(rep) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(req[0], F_SETPIPE_RLOWAT, 0) != -1 ||
+     fcntl(req[0], F_SETPIPE_RLOWAT, 100) != 0 ||
+     fcntl(rep[0], F_SETPIPE_RLOWAT, 100) != 0){
+    printf("%s: F_SETPIPE_RLOWAT failed\n", s);
+    exit(1);
+  }
+  pfd.fd = req[0];
+  pfd.events = POLLIN;
+  write(req[1], buf, 50);
+  if(poll(&pfd, 1, 0) != 0){
+    printf("%s: POLLIN below the watermark\n", s);
+    exit(1);
+  }
+  write(req[1], buf, 50);
+  if(poll(&pfd, 1, 0) != 1 || read(req[0], buf, sizeof(buf)) != 100){
+    printf("%s: no POLLIN at the watermark\n", s);
+    exit(1);
+  }
+  write(req[1], buf, 50);
+  if(poll(&pfd, 1, -1) != 1 || read(req[0], buf, sizeof(buf)) != 50){
+    printf("%s: no POLLIN once the writer went idle\n", s);
+    exit(1);
+  }
+
+  // a busy writer's small writes shouldn't wake the reader.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 10; i++)
+      write(req[1], buf, 10);
+    exit(0);
+  }
+  n = read(req[0], buf, sizeof(buf));
+  if(n != 100){
+    printf("%s: read returned %d before the watermark\n", s, n);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 3; i++){
+      if(read(req[0], &c, 1) != 1 || write(rep[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < 3; i++){
+    c = i;
+    if(write(req[1], &c, 1) != 1 || read(rep[0], &c, 1) != 1 || c != i){
+      printf("%s: no reply to request %d\n", s, i);
+      exit(1);
+    }
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  close(req[0]);
+  close(req[1]);
+  close(rep[0]);
+  close(rep[1]);
+}
+
+// splice a file into a pipe, tee it into a second
+// pipe, and splice the first pipe out to another file.
+void
+splicetest(char *s)
+{
+  int a[2], b[2], fd, out, i;
+  enum { N=3000 };
+
+  for(i = 0; i < N; i++)
+    buf[i] = i % 253;
+  fd = open("splicefile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: create splicefile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("splicefile", O_RDONLY);
+  out = open("splicefile2", O_CREATE|O_RDWR);
+  if(fd < 0 || out < 0 || pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(splice(fd, out, N) != -1 || tee(fd, a[1], N) != -1){
+    printf("%s: splice between files succeeded\n", s);
+    exit(1);
+  }
+  if(splice(fd, a[1], 10000) != N || splice(fd, a[1], 10000) != 0){
+    printf("%s: splice from file failed\n", s);
+    exit(1);
+  }
+  if(tee(a[0], b[1], 10000) != N){
+    printf("%s: tee failed\n", s);
+    exit(1);
+  }
+  if(splice(a[0], out, 10000) != N){
+    printf("%s: splice to file failed\n", s);
+    exit(1);
+  }
+  close(a[1]);
+  if(splice(a[0], out, 10000) != 0){
+    printf("%s: splice from empty closed pipe returned data\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  if(read(b[0], buf, N) != N){
+    printf("%s: read of teed pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i % 253)){
+      printf("%s: wrong data in teed pipe\n", s);
+      exit(1);
+    }
+  }
+  memset(buf, 0, N);
+  if(pread(out, buf, N, 0) != N){
+    printf("%s: read of splicefile2 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i % 253)){
+      printf("%s: wrong data in splicefile2\n", s);
+      exit(1);
+    }
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+  close(fd);
+  close(out);
+  unlink("splicefile");
+  unlink("splicefile2");
+}
+
+// vmsplice() two pages into a pipe and read them back
+// into page-aligned memory, so that the pages move
+// rather than being copied; writes on either side
+// afterwards must not show through to the other.
+void
+vmsplicetest(char *s)
+{
+  int fds[2], i, pid, xstatus;
+  char *w, *r;
+  struct iovec iov;
+
+  w = sbrk(0);
+  w = sbrk(PGROUNDUP((uint64)w) - (uint64)w + 4*PGSIZE);
+  if(w == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  w = (char*)PGROUNDUP((uint64)w);
+  r = w + 2*PGSIZE;
+  for(i = 0; i < 2*PGSIZE; i++)
+    w[i] = i % 249;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fcntl(fds[1], F_SETPIPE_SZ, 2*PGSIZE);
+  iov.iov_base = w;
+  iov.iov_len = 2*PGSIZE;
+  if(vmsplice(fds[1], &iov, 1) != 2*PGSIZE){
+    printf("%s: vmsplice failed\n", s);
+    exit(1);
+  }
+  w[0] = 'w';
+  if(read(fds[0], r, 2*PGSIZE) != 2*PGSIZE){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*PGSIZE; i++){
+    if(r[i] != (char)(i % 249)){
+      printf("%s: wrong data read at %d\n", s, i);
+      exit(1);
+    }
+  }
+  r[PGSIZE] = 'r';
+  if(w[PGSIZE] != (char)(PGSIZE % 249)){
+    printf("%s: reader's write seen by writer\n", s);
+    exit(1);
+  }
+
+  // w's second page is still copy-on-write, shared with
+  // the page the reader got; fork must give the child a
+  // private copy it can write, leaving the parent's alone.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    w[PGSIZE] = 'c';
+    exit(w[PGSIZE] == 'c' && w[PGSIZE+1] == (char)((PGSIZE+1) % 249) ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || w[PGSIZE] != (char)(PGSIZE % 249) || r[PGSIZE] != 'r'){
+    printf("%s: fork of copy-on-write pages went wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// message queues keep message boundaries, deliver the
+// highest priority first, and block or fail when empty or full.
+void
+mqtest(char *s)
+{
+  struct mq_attr attr;
+  int q, pid, xstatus, prio, i;
+  char m[MQ_MSGSIZE];
+
+  mq_unlink("/mqtest");
+  if(mq_open("/mqtest", O_RDWR, 0) != -1){
+    printf("%s: opened a missing queue\n", s);
+    exit(1);
+  }
+  attr.mq_flags = 0;
+  attr.mq_maxmsg = 4;
+  attr.mq_msgsize = 64;
+  q = mq_open("/mqtest", O_CREATE|O_RDWR|O_NONBLOCK, &attr);
+  if(q < 0){
+    printf("%s: mq_open failed\n", s);
+    exit(1);
+  }
+  if(mq_receive(q, m, sizeof(m), &prio) != -EAGAIN){
+    printf("%s: receive from empty queue didn't fail\n", s);
+    exit(1);
+  }
+  if(mq_send(q, "low", 3, 1) != 0 || mq_send(q, "high", 4, 7) != 0 ||
+     mq_send(q, "low2", 4, 1) != 0 || mq_send(q, "mid", 3, 4) != 0){
+    printf("%s: mq_send failed\n", s);
+    exit(1);
+  }
+  if(mq_send(q, "full", 4, 0) != -EAGAIN || mq_send(q, m, 65, 0) != -1 ||
+     mq_send(q, "x", 1, MQ_PRIO_MAX) != -1){
+    printf("%s: bad mq_send succeeded\n", s);
+    exit(1);
+  }
+  if(mq_getattr(q, &attr) != 0 || attr.mq_curmsgs != 4 ||
+     attr.mq_msgsize != 64 || attr.mq_flags != O_NONBLOCK){
+    printf("%s: mq_getattr wrong\n", s);
+    exit(1);
+  }
+  if(mq_receive(q, m, 10, &prio) != -1){
+    printf("%s: receive into a short buffer succeeded\n", s);
+    exit(1);
+  }
+  if(mq_receive(q, m, sizeof(m), &prio) != 4 || memcmp(m, "high", 4) != 0 || prio != 7 ||
+     mq_receive(q, m, sizeof(m), &prio) != 3 || memcmp(m, "mid", 3) != 0 || prio != 4 ||
+     mq_receive(q, m, sizeof(m), &prio) != 3 || memcmp(m, "low", 3) != 0 || prio != 1 ||
+     mq_receive(q, m, sizeof(m), 0) != 4 || memcmp(m, "low2", 4) != 0){
+    printf("%s: messages out of order\n", s);
+    exit(1);
+  }
+  if(read(q, m, 1) != -1 || write(q, m, 1) != -1){
+    printf("%s: read/write on a queue succeeded\n", s);
+    exit(1);
+  }
+  close(q);
+
+  // a blocking receiver waits for a slow sender.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    q = mq_open("/mqtest", O_WRONLY, 0);
+    if(q < 0)
+      exit(1);
+    for(i = 0; i < 20; i++){
+      if(i % 5 == 0)
+        sleep(1);
+      if(mq_send(q, (char*)&i, sizeof(i), 0) != 0)
+        exit(1);
+    }
+    exit(0);
+  }
+  q = mq_open("/mqtest", O_RDONLY, 0);
+  if(q < 0){
+    printf("%s: reopen failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    if(mq_receive(q, m, sizeof(m), 0) != sizeof(i) || *(int*)m != i){
+      printf("%s: blocking receive %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: sender failed\n", s);
+    exit(1);
+  }
+
+  // unlinking hides the name, but the open queue still works.
+  if(mq_unlink("/mqtest") != 0 || mq_open("/mqtest", O_RDWR, 0) != -1){
+    printf("%s: mq_unlink failed\n", s);
+    exit(1);
+  }
+  close(q);
+}
+
+// a socketpair is two-way, and a listening socket
+// bound to a path accepts connections from several clients.
+void
+socktest(char *s)
+{
+  int sv[2], l, c, i, pid, xstatus, n;
+  struct pollfd pfd;
+  struct stat st;
+  char b[8];
+  enum { NCLIENT=3 };
+
+  if(socketpair(sv) < 0){
+    printf("%s: socketpair failed\n", s);
+    exit(1);
+  }
+  if(write(sv[0], "ping", 4) != 4 || read(sv[1], b, sizeof(b)) != 4 || memcmp(b, "ping", 4) != 0 ||
+     write(sv[1], "pong", 4) != 4 || read(sv[0], b, sizeof(b)) != 4 || memcmp(b, "pong", 4) != 0){
+    printf("%s: socketpair transfer failed\n", s);
+    exit(1);
+  }
+  if(fcntl(sv[0], F_GETPIPE_SZ, 0) != 4096 || fcntl(sv[0], F_SETPIPE_SZ, 8192) != 8192 ||
+     fcntl(sv[0], F_GETPIPE_SZ, 0) != 8192 || fcntl(sv[1], F_GETPIPE_SZ, 0) != 4096 ||
+     fcntl(sv[0], F_SETPIPE_RLOWAT, 4) != 0 || fcntl(sv[0], F_SETPIPE_WLOWAT, 0) != 0){
+    printf("%s: pipe fcntl on a socket failed\n", s);
+    exit(1);
+  }
+  close(sv[0]);
+  if(read(sv[1], b, sizeof(b)) != 0){
+    printf("%s: no hangup\n", s);
+    exit(1);
+  }
+  close(sv[1]);
+
+  unlink("socktest.sock");
+  l = socket();
+  c = socket();
+  if(l < 0 || c < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(connect(c, "socktest.sock") != -1 || listen(l, NCLIENT) != -1 ||
+     read(l, b, 1) != -1){
+    printf("%s: unbound socket worked\n", s);
+    exit(1);
+  }
+  if(bind(l, "socktest.sock") != 0 || bind(c, "socktest.sock") != -1 ||
+     open("socktest.sock", O_RDWR) != -1){
+    printf("%s: bind failed\n", s);
+    exit(1);
+  }
+  if(bind(l, "socktest.sock2") != -1 || stat("socktest.sock2", &st) != -1){
+    printf("%s: second bind left an inode\n", s);
+    exit(1);
+  }
+  if(connect(c, "socktest.sock") != -1){
+    printf("%s: connected before listen\n", s);
+    exit(1);
+  }
+  close(c);
+  if(listen(l, NCLIENT - 1) != 0){
+    printf("%s: listen failed\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < NCLIENT; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(l);
+      c = socket();
+      if(c < 0 || connect(c, "socktest.sock") != 0)
+        exit(1);
+      b[0] = 'a' + i;
+      if(write(c, b, 1) != 1 || read(c, b, sizeof(b)) != 1 || b[0] != 'A' + i)
+        exit(1);
+      exit(0);
+    }
+  }
+  pfd.fd = l;
+  pfd.events = POLLIN;
+  for(i = 0; i < NCLIENT; i++){
+    if(poll(&pfd, 1, -1) != 1 || (c = accept(l)) < 0){
+      printf("%s: accept failed\n", s);
+      exit(1);
+    }
+    if((n = read(c, b, sizeof(b))) != 1 || b[0] < 'a' || b[0] >= 'a' + NCLIENT){
+      printf("%s: read %d from client\n", s, n);
+      exit(1);
+    }
+    b[0] += 'A' - 'a';
+    write(c, b, 1);
+    close(c);
+  }
+  for(i = 0; i < NCLIENT; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: client failed\n", s);
+      exit(1);
+    }
+  }
+
+  close(l);
+  c = socket();
+  if(connect(c, "socktest.sock") != -1){
+    printf("%s: connected to a closed listener\n", s);
+    exit(1);
+  }
+  close(c);
+  unlink("socktest.sock");
+}
+
+// open, write, fsync, read and close a file with one
+// uring_enter() per batch.
+void
+uringtest(char *s)
+{
+  struct uring *r;
+  struct uring_sqe *sqe;
+  char rbuf[5];
+  int i, fd;
+
+  if((r = uring_setup()) == (struct uring*)-1){
+    printf("%s: uring_setup failed\n", s);
+    exit(1);
+  }
+
+  sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+  sqe->op = URING_OPEN;
+  sqe->addr = (uint64)"uringfile";
+  sqe->len = O_CREATE|O_RDWR;
+  sqe->data = 1;
+  if(uring_enter(1) != 1 || r->cq_tail != 1 || r->cq[0].data != 1 || r->cq[0].res < 0){
+    printf("%s: uring open failed\n", s);
+    exit(1);
+  }
+  fd = r->cq[0].res;
+  r->cq_head++;
+
+  for(i = 0; i < 3; i++){
+    sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+    sqe->fd = fd;
+    sqe->off = -1;
+    sqe->data = 2 + i;
+  }
+  r->sq[1].op = URING_WRITE;
+  r->sq[1].addr = (uint64)"hello";
+  r->sq[1].len = 5;
+  r->sq[2].op = URING_FSYNC;
+  r->sq[3].op = URING_READ;
+  r->sq[3].addr = (uint64)rbuf;
+  r->sq[3].len = 5;
+  r->sq[3].off = 0;
+  if(uring_enter(3) != 3 || r->cq_tail != 4){
+    printf("%s: uring_enter ran too few\n", s);
+    exit(1);
+  }
+  for(i = 1; i < 4; i++){
+    if(r->cq[i].data != i + 1 || r->cq[i].res != (i == 2 ? 0 : 5)){
+      printf("%s: wrong completion %d\n", s, i);
+      exit(1);
+    }
+  }
+  r->cq_head = r->cq_tail;
+  if(memcmp(rbuf, "hello", 5) != 0){
+    printf("%s: uring read wrong data\n", s);
+    exit(1);
+  }
+
+  sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+  sqe->op = URING_CLOSE;
+  sqe->fd = fd;
+  if(uring_enter(1) != 1 || r->cq[4].res != 0 || close(fd) != -1){
+    printf("%s: uring close failed\n", s);
+    exit(1);
+  }
+  unlink("uringfile");
+}
+
+// run several system calls in one syscall_batch().
+void
+batchtest(char *s)
+{
+  struct sysop ops[4];
+  struct stat st;
+  int fds[2];
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  memset(ops, 0, sizeof(ops));
+  ops[0].num = SYS_getpid;
+  ops[1].num = SYS_write;
+  ops[1].args[0] = fds[1];
+  ops[1].args[1] = (uint64)"batch";
+  ops[1].args[2] = 5;
+  ops[2].num = SYS_fstat;
+  ops[2].args[0] = -1;
+  ops[2].args[1] = (uint64)&st;
+  ops[3].num = SYS_close;
+  ops[3].args[0] = fds[1];
+
+  if(syscall_batch(ops, 4, BATCH_STOPERR) != 3){
+    printf("%s: batch did not stop at the failed call\n", s);
+    exit(1);
+  }
+  if(ops[0].ret != getpid() || ops[1].ret != 5 || (int)ops[2].ret != -1){
+    printf("%s: wrong batch results\n", s);
+    exit(1);
+  }
+  ops[0].num = SYS_fork;
+  if(syscall_batch(ops, 4, 0) != 4 || (int)ops[0].ret != -1 || ops[3].ret != 0){
+    printf("%s: wrong results without BATCH_STOPERR\n", s);
+    exit(1);
+  }
+  if(close(fds[1]) != -1){
+    printf("%s: batched close did not close\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// the USYSCALL page agrees with getpid() and uptime(),
+// and can't be written.
+void
+usyscalltest(char *s)
+{
+  int pid, t0, t1, t2, xstatus;
+
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid() %d != getpid() %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  // the kernel works ticks out the same way, but only when
+  // the timer interrupts, so uuptime() may be one ahead.
+  t0 = uptime();
+  t1 = uuptime();
+  t2 = uptime();
+  if(t1 < t0 || t1 > t2 + 1){
+    printf("%s: uuptime() %d outside uptime() %d..%d\n", s, t1, t0, t2 + 1);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(ugetpid() != getpid())
+      exit(1);
+    *(int*)USYSCALL = 0;
+    exit(1);  // should have been killed
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: write to USYSCALL page not killed\n", s);
+    exit(1);
+  }
+}
+
+// sysinfo() should see pages allocated by sbrk()
+// and the process table slot taken by fork().
+void
+sysinfotest(char *s)
+{
+  struct sysinfo si0, si1;
+  int pid, xstatus;
+  enum { N=16 };
+
+  if(sysinfo(&si0) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  if(si0.procused < 1 || si0.procused > si0.nproc || si0.logused > si0.logsize){
+    printf("%s: bad sysinfo\n", s);
+    exit(1);
+  }
+  if(sbrk(N*4096) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  sysinfo(&si1);
+  if(si1.freepages > si0.freepages - N){
+    printf("%s: freepages %d after sbrk, %d before\n", s, si1.freepages, si0.freepages);
+    exit(1);
+  }
+  sbrk(-N*4096);
+  sysinfo(&si0);
+  if(si0.freepages < si1.freepages + N){
+    printf("%s: sbrk(-n) did not free pages\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sysinfo(&si1);
+    exit(si1.procused > si0.procused ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: sysinfo did not count child\n", s);
+    exit(1);
+  }
+}
+
+// descriptors beyond the first page of the fd table
+// (NFDPAGE, 512, per page) come out lowest first, a closed
+// one is reused, and fork() copies them all.
+void
+fdtabletest(char *s)
+{
+  enum { N=600 };
+  struct stat st;
+  int fd, i, pid, xstatus;
+
+  unlink("fdtablefile");
+  fd = open("fdtablefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 1; i <= N; i++){
+    if(dup(fd) != fd + i){
+      printf("%s: dup %d didn't return %d\n", s, i, fd + i);
+      exit(1);
+    }
+  }
+  close(fd + 10);
+  if(dup(fd) != fd + 10){
+    printf("%s: closed fd not reused\n", s);
+    exit(1);
+  }
+  if(write(fd + N, "x", 1) != 1){
+    printf("%s: write to fd %d failed\n", s, fd + N);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(write(fd + N, "y", 1) != 1 || write(fd + N/2, "z", 1) != 1)
+      exit(1);
+    close(fd + N);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child can't use high fds\n", s);
+    exit(1);
+  }
+  if(fstat(fd + N, &st) < 0 || st.size != 3){
+    printf("%s: parent's fd %d broken after fork\n", s, fd + N);
+    exit(1);
+  }
+  for(i = 0; i <= N; i++)
+    close(fd + i);
+  unlink("fdtablefile");
+}
+
+// two traced processes at once each get a session of
+// their own, which a fork()ed child joins, with its own
+// calls and histograms; draining one leaves the other's.
+void
+tracetest(char *s)
+{
+  struct traceent e[16];
+  uint64 hist[NHIST];
+  int pid[2], i, j, n, xstatus, tot;
+
+  for(i = 0; i < 2; i++){
+    pid[i] = fork();
+    if(pid[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid[i] == 0){
+      if(trace(1UL << SYS_getpid) < 0)
+        exit(1);
+      for(j = 0; j < 3 + 2*i; j++)
+        getpid();
+      if(i == 0){
+        if(fork() == 0){
+          getpid();
+          exit(0);
+        }
+        wait(0);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < 2; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: traced child failed\n", s);
+      exit(1);
+    }
+  }
+
+  for(i = 0; i < 2; i++){
+    n = tracebuf(pid[i], e, sizeof(e)/sizeof(e[0]));
+    if(n != 4 + i){
+      printf("%s: session %d drained %d calls\n", s, i, n);
+      exit(1);
+    }
+    for(j = 0; j < n; j++){
+      if(e[j].num != SYS_getpid || e[j].ret != e[j].pid ||
+         (i == 1 && e[j].pid != pid[1]) || e[j].end < e[j].start){
+        printf("%s: bad entry for pid %d\n", s, e[j].pid);
+        exit(1);
+      }
+    }
+    if(tracebuf(pid[i], e, sizeof(e)/sizeof(e[0])) != 0){
+      printf("%s: session %d drained twice\n", s, i);
+      exit(1);
+    }
+    if(tracehist(pid[i], SYS_getpid, hist) < 0){
+      printf("%s: tracehist failed\n", s);
+      exit(1);
+    }
+    for(tot = j = 0; j < NHIST; j++)
+      tot += hist[j];
+    if(tot != 4 + i){
+      printf("%s: session %d histogram holds %d calls\n", s, i, tot);
+      exit(1);
+    }
+    tracehist(pid[i], SYS_write, hist);
+    for(j = 0; j < NHIST; j++){
+      if(hist[j] != 0){
+        printf("%s: untraced call in histogram\n", s);
+        exit(1);
+      }
+    }
+  }
+  if(tracebuf(getpid(), e, sizeof(e)/sizeof(e[0])) != -1){
+    printf("%s: untraced process has a session\n", s);
+    exit(1);
+  }
+}
+
 // simple fork and pipe read/write
 
 void
@@ -2157,11 +3445,30 @@ main(int argc, char *argv[])
     {writetest, "writetest"},
     {writebig, "writebig"},
     {createtest, "createtest"},
+    {copyfiletest, "copyfiletest"},
+    {readdirplustest, "readdirplustest"},
+    {statfstest, "statfstest"},
+    {prwtest, "prwtest"},
     {openiputtest, "openiput"},
     {exitiputtest, "exitiput"},
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {iovtest, "iovtest"},
+    {polltest, "polltest"},
+    {nonblocktest, "nonblocktest"},
+    {pipesizetest, "pipesizetest"},
+    {lowattest, "lowattest"},
+    {splicetest, "splicetest"},
+    {vmsplicetest, "vmsplicetest"},
+    {mqtest, "mqtest"},
+    {socktest, "socktest"},
+    {uringtest, "uringtest"},
+    {batchtest, "batchtest"},
+    {usyscalltest, "usyscalltest"},
+    {sysinfotest, "sysinfotest"},
+    {tracetest, "tracetest"},
+    {fdtabletest, "fdtabletest"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
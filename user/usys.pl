@@ -37,3 +37,34 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("ntas");
+entry("readdirplus");
+entry("statfs");
+entry("copy_file_range");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("poll");
+entry("pipe2");
+entry("fcntl");
+entry("uring_setup");
+entry("uring_enter");
+entry("syscall_batch");
+entry("trace");
+entry("tracebuf");
+entry("tracehist");
+entry("sysinfo");
+entry("splice");
+entry("tee");
+entry("vmsplice");
+entry("mq_open");
+entry("mq_send");
+entry("mq_receive");
+entry("mq_unlink");
+entry("mq_getattr");
+entry("socket");
+entry("socketpair");
+entry("bind");
+entry("listen");
+entry("accept");
+entry("connect");